@@ -0,0 +1,211 @@
+#ifndef EDIT_DISTANCE_COST_POLICY_H
+#define EDIT_DISTANCE_COST_POLICY_H
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "edit_distance.h"
+
+namespace edit_distance {
+// The DP costs are integers: 'unit' per add/remove and 'unit + 1' per
+// replace, so a path with a adds/removes and b replaces costs
+// (a + b) * unit + b. A unit of 100000 is exactly the 1.00001 replace
+// penalty. While b < unit, comparing two costs compares (a + b, b)
+// lexicographically, and b never exceeds min(N, M); so any unit above that
+// makes the same choices, and the smallest one keeps the numbers small.
+typedef uint64_t Cost;
+
+inline Cost CostUnit(size_t left_size, size_t right_size) {
+    return std::min<Cost>(std::min(left_size, right_size) + 1, 100000);
+}
+
+// Computes one cell of the Wagner-Fischer DP from its left ('add'), upper
+// ('remove') and upper-left ('replace') neighbours. Stores the cell cost in
+// 'cost' and returns the move that reaches it.
+// Every engine that promises the reference edit script goes through this
+// function so that the costs, and hence the tie-breaking, stay identical.
+inline EditType ChooseMove(bool match, Cost add, Cost remove, Cost replace,
+                           Cost unit, Cost *cost) {
+    if (match) {
+        // Found a match. Consume it.
+        *cost = replace;
+        return kMatch;
+    }
+    if (add < remove && add < replace) {
+        *cost = add + unit;
+        return kAdd;
+    }
+    if (remove < add && remove < replace) {
+        *cost = remove + unit;
+        return kRemove;
+    }
+    // We make replace a little more expensive than add/remove to lower their
+    // priority.
+    *cost = replace + unit + 1;
+    return kReplace;
+}
+
+// Returns the cheapest of the three moves into a DP cell, given the cost of
+// the cell through each of them, and stores that cost in 'cost'. 'replace'
+// is the cost through the diagonal, a match when 'match' is set. Ties go to
+// the diagonal, then to add.
+template <typename CostType>
+inline EditType ChooseCheapestMove(bool match, CostType add, CostType remove,
+                                   CostType replace, CostType *cost) {
+    if (replace <= add && replace <= remove) {
+        *cost = replace;
+        return match ? kMatch : kReplace;
+    }
+    if (add <= remove) {
+        *cost = add;
+        return kAdd;
+    }
+    *cost = remove;
+    return kRemove;
+}
+
+// Cost policies of CalculateOptimalEdits below. A policy for elements of
+// type T has:
+//   typedef ... Cost;  the type of the DP costs, integer or floating point;
+//   void Reset(size_t left_size, size_t right_size);
+//                      called before each DP;
+//   Cost Add(const T &right) const;
+//   Cost Remove(const T &left) const;
+//   EditType Choose(const T &left, const T &right, Cost add, Cost remove,
+//                   Cost replace, Cost *cost) const;
+//                      the move into a cell, as ChooseMove, from the costs
+//                      of its left, upper and upper-left neighbours.
+// The DP is instantiated for each policy, so all of these are inlined.
+
+// The costs of the non-template CalculateOptimalEdits: unit costs, with
+// replace a little more expensive than add/remove, and the tie rule of
+// ChooseMove. The edit script is the same as with kWagnerFischer.
+struct UnitCosts {
+    typedef edit_distance::Cost Cost;
+
+    void Reset(size_t left_size, size_t right_size) {
+        unit_ = CostUnit(left_size, right_size);
+    }
+    template <typename T>
+    Cost Add(const T &) const {
+        return unit_;
+    }
+    template <typename T>
+    Cost Remove(const T &) const {
+        return unit_;
+    }
+    template <typename T>
+    EditType Choose(const T &left, const T &right, Cost add, Cost remove,
+                    Cost replace, Cost *cost) const {
+        return ChooseMove(left == right, add, remove, replace, unit_, cost);
+    }
+
+   private:
+    Cost unit_;
+};
+
+// Integer weights fixed at compile time, e.g. FixedCosts<1, 3, 2> for
+// removes three times as expensive as adds. The edit script is a cheapest
+// one, with ties as in ChooseCheapestMove.
+template <unsigned kAdd, unsigned kRemove, unsigned kReplace>
+struct FixedCosts {
+    typedef uint64_t Cost;
+
+    void Reset(size_t, size_t) {}
+    template <typename T>
+    Cost Add(const T &) const {
+        return kAdd;
+    }
+    template <typename T>
+    Cost Remove(const T &) const {
+        return kRemove;
+    }
+    template <typename T>
+    EditType Choose(const T &left, const T &right, Cost add, Cost remove,
+                    Cost replace, Cost *cost) const {
+        const bool match = left == right;
+        return ChooseCheapestMove(match, add + kAdd, remove + kRemove,
+                                  match ? replace : replace + kReplace, cost);
+    }
+};
+
+// Like FixedCosts, for characters, with a replace that only changes the case
+// of a letter costing kCaseReplace.
+template <unsigned kAdd, unsigned kRemove, unsigned kReplace,
+          unsigned kCaseReplace>
+struct CaseCosts : FixedCosts<kAdd, kRemove, kReplace> {
+    typedef uint64_t Cost;
+
+    EditType Choose(char left, char right, Cost add, Cost remove,
+                    Cost replace, Cost *cost) const {
+        const bool match = left == right;
+        const Cost weight =
+            match ? 0
+                  : tolower(static_cast<unsigned char>(left)) ==
+                            tolower(static_cast<unsigned char>(right))
+                        ? kCaseReplace
+                        : kReplace;
+        return ChooseCheapestMove(match, add + kAdd, remove + kRemove,
+                                  replace + weight, cost);
+    }
+};
+
+// Returns a cheapest edit script from 'left' to 'right' under the costs of
+// 'Policy', by the Wagner-Fischer DP with two rows of costs and 2 bits of
+// traceback per cell. 'Sequence' is anything with size() and operator[],
+// e.g. std::string or std::vector<std::string>. With UnitCosts this is the
+// script of the non-template CalculateOptimalEdits with kWagnerFischer.
+template <typename Policy, typename Sequence>
+std::vector<EditType> CalculateOptimalEdits(const Sequence &left,
+                                            const Sequence &right,
+                                            Policy policy = Policy()) {
+    typedef typename Policy::Cost PolicyCost;
+    const size_t rows = left.size(), cols = right.size();
+    policy.Reset(rows, cols);
+
+    // Row l_i of the traceback holds the moves into cells (l_i + 1, 1..cols),
+    // 32 per word.
+    const size_t row_words = (cols + 31) / 32;
+    std::vector<uint64_t> moves(rows * row_words);
+    std::vector<PolicyCost> prev(cols + 1), row(cols + 1);
+    prev[0] = 0;
+    for (size_t r_i = 0; r_i < cols; ++r_i) {
+        prev[r_i + 1] = prev[r_i] + policy.Add(right[r_i]);
+    }
+    for (size_t l_i = 0; l_i < rows; ++l_i) {
+        row[0] = prev[0] + policy.Remove(left[l_i]);
+        uint64_t *out = moves.data() + l_i * row_words;
+        for (size_t r_i = 0; r_i < cols; ++r_i) {
+            const EditType move =
+                policy.Choose(left[l_i], right[r_i], row[r_i], prev[r_i + 1],
+                              prev[r_i], &row[r_i + 1]);
+            out[r_i / 32] |= static_cast<uint64_t>(move) << (r_i % 32 * 2);
+        }
+        prev.swap(row);
+    }
+
+    std::vector<EditType> path;
+    path.reserve(rows + cols);
+    for (size_t l_i = rows, r_i = cols; l_i > 0 || r_i > 0;) {
+        EditType move = l_i == 0   ? kAdd
+                        : r_i == 0 ? kRemove
+                                   : static_cast<EditType>(
+                                         (moves[(l_i - 1) * row_words +
+                                                (r_i - 1) / 32] >>
+                                          ((r_i - 1) % 32 * 2)) &
+                                         3);
+        path.push_back(move);
+        l_i -= move != kAdd;
+        r_i -= move != kRemove;
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+}  // namespace edit_distance
+
+#endif  // EDIT_DISTANCE_COST_POLICY_H
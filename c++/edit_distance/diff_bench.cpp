@@ -0,0 +1,336 @@
+/* Edit scripts and unified diffs of generated inputs, with the time, memory
+ * and allocations they took, as JSON.
+ *
+ * Usage: diff_bench [-a algorithm] [-s sizes] [-m rate] [-n runs]
+ *                   [-r seed]
+ *
+ * For each workload and size, a left and a right input are generated from
+ * the seed:
+ *   random     two unrelated sequences of 'size' ids out of 4, as if the
+ *              letters of DNA strands;
+ *   mutated    'size' lines of text and a copy where each line is replaced,
+ *              removed or followed by a new line with probability 'rate';
+ *   different  'size' lines on each side, with no line in common.
+ * CalculateOptimalEdits, and CreateUnifiedDiff for the line workloads, run
+ * 'runs' times on them. Each case runs in a child process, so that the peak
+ * RSS it reports is its own.
+ *
+ * The report goes to stdout as one JSON object with a "cases" array. A case
+ * has the best time of the runs in ns and in ns per DP cell (left size times
+ * right size), the heap allocations and bytes of the last run, when the
+ * thread-local Workspace is warm, and the peak RSS in KB.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "edit_distance.h"
+
+// Heap allocations and their bytes so far. GCC takes the free() below for a
+// mismatch with the new of the callers it inlines them into.
+static std::atomic<size_t> allocations(0), allocated_bytes(0);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t size) {
+    ++allocations;
+    allocated_bytes += size;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    ++allocations;
+    allocated_bytes += size;
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+
+#pragma GCC diagnostic pop
+
+static const struct {
+    const char *name;
+    edit_distance::Algorithm algorithm;
+} kAlgorithms[] = {
+    {"wagner-fischer", edit_distance::kWagnerFischer},
+    {"myers", edit_distance::kMyers},
+    {"linear-space", edit_distance::kLinearSpace},
+    {"parallel", edit_distance::kParallel},
+    {"patience", edit_distance::kPatience},
+    {"histogram", edit_distance::kHistogram},
+    {"sorted", edit_distance::kSorted},
+};
+
+enum Workload { kRandom, kMutated, kDifferent };
+
+static const char *const kWorkloads[] = {"random", "mutated", "different"};
+
+enum Function { kOptimalEdits, kUnifiedDiff };
+
+static const char *const kFunctions[] = {"CalculateOptimalEdits",
+                                         "CreateUnifiedDiff"};
+
+static void usage(const char *program) {
+    size_t i;
+
+    fprintf(stderr,
+            "Usage: %s [-a algorithm] [-s sizes] [-m rate] [-n runs] "
+            "[-r seed]\n"
+            "  -a  algorithm (default wagner-fischer):",
+            program);
+    for (i = 0; i < sizeof(kAlgorithms) / sizeof(kAlgorithms[0]); ++i) {
+        fprintf(stderr, " %s", kAlgorithms[i].name);
+    }
+    fprintf(stderr,
+            "\n"
+            "  -s  comma separated sizes, in ids for the random workload\n"
+            "      and in lines for the others (default 100,1000,10000)\n"
+            "  -m  share of the lines the mutated workload changes\n"
+            "      (default 0.01)\n"
+            "  -n  timed runs per case (default 3)\n"
+            "  -r  seed of the generated inputs (default 1)\n");
+}
+
+// A line of 'words' random lowercase words, e.g. "  qxv mebzo tlk".
+static std::string RandomLine(std::mt19937_64 *random, size_t words) {
+    std::string line(2 * ((*random)() % 3), ' ');
+    for (size_t i = 0; i < words; ++i) {
+        if (i > 0) line += ' ';
+        const size_t length = 1 + (*random)() % 8;
+        for (size_t j = 0; j < length; ++j) {
+            line += static_cast<char>('a' + (*random)() % 26);
+        }
+    }
+    return line;
+}
+
+// Fills 'left' and 'right' with the lines of 'workload'; see the top of the
+// file. A line is numbered so that the lines of a side are distinct, as in
+// most source files, and the sides of kDifferent have no line in common.
+static void GenerateLines(Workload workload, size_t size, double rate,
+                          std::mt19937_64 *random,
+                          std::vector<std::string> *left,
+                          std::vector<std::string> *right) {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    size_t number = 0;
+    for (size_t i = 0; i < size; ++i) {
+        left->push_back(std::to_string(number++) + RandomLine(random, 5));
+    }
+    if (workload == kDifferent) {
+        for (size_t i = 0; i < size; ++i) {
+            right->push_back(std::to_string(number++) + RandomLine(random, 5));
+        }
+        return;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        const double u = uniform(*random);
+        if (u < rate / 3) {
+            // Replaced.
+            right->push_back(std::to_string(number++) + RandomLine(random, 5));
+        } else if (u < rate * 2 / 3) {
+            // Removed.
+        } else if (u < rate) {
+            // Followed by a new line.
+            right->push_back((*left)[i]);
+            right->push_back(std::to_string(number++) + RandomLine(random, 5));
+        } else {
+            right->push_back((*left)[i]);
+        }
+    }
+}
+
+static std::vector<size_t> RandomIds(std::mt19937_64 *random, size_t size) {
+    std::vector<size_t> ids(size);
+    for (size_t i = 0; i < size; ++i) ids[i] = (*random)() % 4;
+    return ids;
+}
+
+// Times 'call' 'runs' times and prints the JSON object of the case, without
+// a newline.
+template <typename Call>
+static void RunCase(Workload workload, Function function, size_t size,
+                    size_t left_size, size_t right_size, size_t runs,
+                    const Call &call) {
+    double best = 0;
+    size_t run_allocations = 0, run_bytes = 0;
+    for (size_t run = 0; run < runs; ++run) {
+        const size_t before = allocations, before_bytes = allocated_bytes;
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        call();
+        const double ns = std::chrono::duration<double, std::nano>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+        run_allocations = allocations - before;
+        run_bytes = allocated_bytes - before_bytes;
+        if (run == 0 || ns < best) best = ns;
+    }
+    const double cells = static_cast<double>(left_size) * right_size;
+
+    struct rusage resources;
+    getrusage(RUSAGE_SELF, &resources);
+    printf("    {\"workload\": \"%s\", \"function\": \"%s\", \"size\": %zu, "
+           "\"left\": %zu, \"right\": %zu, \"ns\": %.0f, "
+           "\"ns_per_cell\": %.4g, \"allocations\": %zu, "
+           "\"allocated_bytes\": %zu, \"peak_rss_kb\": %ld}",
+           kWorkloads[workload], kFunctions[function], size, left_size,
+           right_size, best, cells > 0 ? best / cells : 0.0, run_allocations,
+           run_bytes, resources.ru_maxrss);
+}
+
+// Generates the inputs of a case and runs it. Called in the child process.
+static void GenerateAndRun(Workload workload, Function function, size_t size,
+                           double rate, size_t runs, uint64_t seed,
+                           const edit_distance::DiffOptions &options) {
+    std::mt19937_64 random(seed);
+    size_t result = 0;
+    if (workload == kRandom) {
+        const std::vector<size_t> left = RandomIds(&random, size);
+        const std::vector<size_t> right = RandomIds(&random, size);
+        RunCase(workload, function, size, left.size(), right.size(), runs,
+                [&]() {
+                    result += edit_distance::CalculateOptimalEdits(
+                                  left, right, options.algorithm)
+                                  .size();
+                });
+    } else {
+        std::vector<std::string> left, right;
+        GenerateLines(workload, size, rate, &random, &left, &right);
+        RunCase(workload, function, size, left.size(), right.size(), runs,
+                [&]() {
+                    if (function == kOptimalEdits) {
+                        result += edit_distance::CalculateOptimalEdits(
+                                      left, right, options.algorithm)
+                                      .size();
+                    } else {
+                        result += edit_distance::CreateUnifiedDiff(left, right,
+                                                                   options)
+                                      .size();
+                    }
+                });
+    }
+    // Keeps the calls from being optimized away.
+    if (result == 1) fputc(' ', stderr);
+}
+
+int main(int argc, char *argv[]) {
+    edit_distance::DiffOptions options;
+    std::vector<size_t> sizes;
+    double rate = 0.01;
+    size_t runs = 3;
+    uint64_t seed = 1;
+
+    int opt;
+    size_t i;
+    while ((opt = getopt(argc, argv, "a:s:m:n:r:")) != -1) {
+        switch (opt) {
+            case 'a':
+                for (i = 0; i < sizeof(kAlgorithms) / sizeof(kAlgorithms[0]);
+                     ++i) {
+                    if (strcmp(optarg, kAlgorithms[i].name) == 0) break;
+                }
+                if (i == sizeof(kAlgorithms) / sizeof(kAlgorithms[0])) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                options.algorithm = kAlgorithms[i].algorithm;
+                break;
+            case 's': {
+                const char *p = optarg;
+                for (;;) {
+                    char *end;
+                    sizes.push_back(strtoul(p, &end, 10));
+                    if (end == p || (*end != ',' && *end != '\0')) {
+                        usage(argv[0]);
+                        return 2;
+                    }
+                    if (*end == '\0') break;
+                    p = end + 1;
+                }
+                break;
+            }
+            case 'm':
+                rate = strtod(optarg, NULL);
+                break;
+            case 'n':
+                runs = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (argc != optind || runs == 0 || !(rate >= 0 && rate <= 1)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (sizes.empty()) sizes = {100, 1000, 10000};
+    for (i = 0; i < sizeof(kAlgorithms) / sizeof(kAlgorithms[0]); ++i) {
+        if (kAlgorithms[i].algorithm == options.algorithm) break;
+    }
+
+    printf("{\"algorithm\": \"%s\", \"mutation_rate\": %g, \"runs\": %zu, "
+           "\"seed\": %llu, \"cases\": [",
+           kAlgorithms[i].name, rate, runs,
+           static_cast<unsigned long long>(seed));
+    bool first = true;
+    for (int workload = kRandom; workload <= kDifferent; ++workload) {
+        for (int function = kOptimalEdits; function <= kUnifiedDiff;
+             ++function) {
+            if (workload == kRandom && function == kUnifiedDiff) continue;
+            for (size_t size : sizes) {
+                printf(first ? "\n" : ",\n");
+                first = false;
+                // The child inherits the buffer of stdout, which has to be
+                // empty so that it is not written twice.
+                if (fflush(stdout) != 0) return 2;
+                const pid_t pid = fork();
+                if (pid < 0) {
+                    fprintf(stderr, "%s: cannot fork: %s\n", argv[0],
+                            strerror(errno));
+                    return 2;
+                }
+                if (pid == 0) {
+                    GenerateAndRun(static_cast<Workload>(workload),
+                                   static_cast<Function>(function), size,
+                                   rate, runs, seed, options);
+                    _exit(fflush(stdout) == 0 ? 0 : 2);
+                }
+                int status;
+                if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+                    WEXITSTATUS(status) != 0) {
+                    fprintf(stderr, "%s: %s %s %zu failed\n", argv[0],
+                            kWorkloads[workload], kFunctions[function],
+                            size);
+                    return 2;
+                }
+            }
+        }
+    }
+    printf("\n  ]}\n");
+    if (fflush(stdout) != 0) return 2;
+    return 0;
+}
@@ -0,0 +1,410 @@
+#include "diff_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace edit_distance {
+inline uint64_t RotateLeft(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+// The finalizer of MurmurHash3: every input bit flips each output bit with
+// probability close to 1/2.
+inline uint64_t FinalMix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    return x ^ (x >> 33);
+}
+
+// The state of HashLines: the two lanes of the body of MurmurHash3_x64_128.
+class LineHasher {
+   public:
+    LineHasher() : h1_(0x9E3779B97F4A7C15ULL), h2_(0xD6E8FEB86659FD93ULL) {}
+
+    void Add(std::string_view line) {
+        const char *p = line.data();
+        size_t size = line.size();
+        for (; size >= 16; p += 16, size -= 16) {
+            uint64_t k1, k2;
+            std::memcpy(&k1, p, 8);
+            std::memcpy(&k2, p + 8, 8);
+            Mix(k1, k2);
+        }
+        uint64_t tail[2] = {0, 0};
+        if (size > 0) std::memcpy(tail, p, size);
+        Mix(tail[0], tail[1]);
+        Mix(line.size(), 0);
+    }
+
+    ContentHash Finish(size_t lines) const {
+        uint64_t h1 = h1_ ^ lines, h2 = h2_ ^ lines;
+        h1 += h2;
+        h2 += h1;
+        h1 = FinalMix(h1);
+        h2 = FinalMix(h2);
+        h1 += h2;
+        h2 += h1;
+        ContentHash hash;
+        hash.low = h1;
+        hash.high = h2;
+        return hash;
+    }
+
+   private:
+    void Mix(uint64_t k1, uint64_t k2) {
+        const uint64_t c1 = 0x87C37B91114253D5ULL, c2 = 0x4CF5AD432745937FULL;
+        h1_ ^= RotateLeft(k1 * c1, 31) * c2;
+        h1_ = (RotateLeft(h1_, 27) + h2_) * 5 + 0x52DCE729;
+        h2_ ^= RotateLeft(k2 * c2, 33) * c1;
+        h2_ = (RotateLeft(h2_, 31) + h1_) * 5 + 0x38495AB5;
+    }
+
+    uint64_t h1_, h2_;
+};
+
+template <typename Line>
+ContentHash HashLinesOf(const std::vector<Line> &lines) {
+    LineHasher hasher;
+    for (size_t i = 0; i < lines.size(); ++i) hasher.Add(lines[i]);
+    return hasher.Finish(lines.size());
+}
+
+ContentHash HashLines(const std::vector<std::string> &lines) {
+    return HashLinesOf(lines);
+}
+
+ContentHash HashLines(const std::vector<std::string_view> &lines) {
+    return HashLinesOf(lines);
+}
+
+// The store is kStoreMagic, then one record per diff: a StoreRecord, the
+// diff, and zeros up to a multiple of 8 bytes. The numbers are in the byte
+// order of the machine.
+const char kStoreMagic[8] = {'E', 'D', 'D', 'I', 'F', 'F', 'S', '2'};
+// Starts each record, so that the records after a torn one or garbage can be
+// found again.
+const char kRecordMagic[8] = {'E', 'D', 'R', 'E', 'C', 'O', 'R', 'D'};
+
+struct StoreRecord {
+    char magic[8];
+    uint64_t key[6];
+    uint64_t size;
+    // The ContentHash of the diff as one line, checked on each read.
+    uint64_t diff_low, diff_high;
+    // FinalMix of the words above, so that a record torn before its end or
+    // garbage is not indexed.
+    uint64_t check;
+};
+
+uint64_t RecordCheck(const StoreRecord &record) {
+    uint64_t check = 0;
+    for (size_t i = 0; i < 6; ++i) check = FinalMix(check ^ record.key[i]);
+    check = FinalMix(check ^ record.size);
+    check = FinalMix(check ^ record.diff_low);
+    return FinalMix(check ^ record.diff_high);
+}
+
+// Returns true, with the header in 'record', if a whole and valid record
+// header is at 'offset' of the 'size' bytes of 'data'.
+bool RecordAt(const char *data, size_t size, size_t offset,
+              StoreRecord *record) {
+    if (offset > size || size - offset < sizeof(*record)) return false;
+    std::memcpy(record, data + offset, sizeof(*record));
+    return std::memcmp(record->magic, kRecordMagic, sizeof(kRecordMagic)) ==
+               0 &&
+           record->check == RecordCheck(*record);
+}
+
+// Returns the offset of the first valid record header at or after 'from',
+// or of the first record magic whose header does not fit yet, or where a
+// magic could start in the last bytes, so that nothing past it is skipped.
+size_t FindRecord(const char *data, size_t size, size_t from) {
+    const std::string_view text(data, size);
+    const std::string_view magic(kRecordMagic, sizeof(kRecordMagic));
+    StoreRecord record;
+    for (size_t found = text.find(magic, from); found != text.npos;
+         found = text.find(magic, found + 1)) {
+        if (size - found < sizeof(record) ||
+            RecordAt(data, size, found, &record)) {
+            return found;
+        }
+    }
+    return std::max(from, size - std::min(size, sizeof(magic) - 1));
+}
+
+// The ContentHash of 'text' as a single line.
+ContentHash HashText(std::string_view text) {
+    LineHasher hasher;
+    hasher.Add(text);
+    return hasher.Finish(1);
+}
+
+// Heap memory of an entry besides its diff: the list and map nodes, about.
+const size_t kEntryOverhead = 64;
+
+bool DiffCache::Key::operator==(const Key &other) const {
+    return std::memcmp(words, other.words, sizeof(words)) == 0;
+}
+
+DiffCache::DiffCache(size_t capacity)
+    : capacity_(capacity),
+      store_fd_(-1),
+      store_mapping_(NULL),
+      store_mapping_size_(0),
+      store_indexed_(0),
+      store_writable_(false) {}
+
+DiffCache::~DiffCache() { CloseStore(); }
+
+void DiffCache::CloseStore() {
+    if (store_mapping_) munmap(store_mapping_, store_mapping_size_);
+    if (store_fd_ >= 0) close(store_fd_);
+    store_fd_ = -1;
+    store_mapping_ = NULL;
+    store_mapping_size_ = 0;
+    store_index_.clear();
+    store_indexed_ = 0;
+    store_writable_ = false;
+}
+
+bool DiffCache::OpenStore(const char *path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CloseStore();
+    store_fd_ = open(path, O_RDWR | O_APPEND | O_CREAT, 0666);
+    if (store_fd_ < 0) return false;
+    struct stat st;
+    char magic[sizeof(kStoreMagic)];
+    bool ok = fstat(store_fd_, &st) == 0;
+    if (ok && st.st_size < static_cast<off_t>(sizeof(kStoreMagic))) {
+        // A new store. Every process that opens it writes the same bytes at
+        // 0 before it appends, so a race does no harm; O_APPEND would put
+        // them at the end.
+        const int fd = open(path, O_WRONLY);
+        ok = fd >= 0 && pwrite(fd, kStoreMagic, sizeof(kStoreMagic), 0) ==
+                            static_cast<ssize_t>(sizeof(kStoreMagic));
+        if (fd >= 0) close(fd);
+    } else if (ok) {
+        ok = pread(store_fd_, magic, sizeof(magic), 0) ==
+             static_cast<ssize_t>(sizeof(magic));
+        if (ok && std::memcmp(magic, kStoreMagic, sizeof(magic)) != 0) {
+            ok = false;
+            errno = EINVAL;
+        }
+    }
+    store_indexed_ = sizeof(kStoreMagic);
+    if (!ok || !IndexStore()) {
+        const int error = errno;
+        CloseStore();
+        errno = error;
+        return false;
+    }
+    store_writable_ = true;
+    return true;
+}
+
+bool DiffCache::IndexStore() {
+    struct stat st;
+    if (fstat(store_fd_, &st) != 0) return false;
+    const size_t size = st.st_size;
+    if (size > store_mapping_size_) {
+        // The records of other processes, and ours, past the mapping.
+        if (store_mapping_) munmap(store_mapping_, store_mapping_size_);
+        store_mapping_ = mmap(NULL, size, PROT_READ, MAP_SHARED, store_fd_, 0);
+        if (store_mapping_ == MAP_FAILED) {
+            // The offsets of the index are of no use without the mapping.
+            const int error = errno;
+            store_mapping_ = NULL;
+            CloseStore();
+            errno = error;
+            return false;
+        }
+        store_mapping_size_ = size;
+    }
+    const char *data = static_cast<const char *>(store_mapping_);
+    const size_t mapped = store_mapping_size_;
+    while (mapped - store_indexed_ >= sizeof(StoreRecord)) {
+        StoreRecord record;
+        if (!RecordAt(data, mapped, store_indexed_, &record)) {
+            // Garbage, or the rest of a torn record. A header is written
+            // before the file grows past it, so it is not a live one.
+            store_indexed_ = FindRecord(data, mapped, store_indexed_ + 1);
+            continue;
+        }
+        const size_t rest = mapped - store_indexed_ - sizeof(record);
+        const size_t end = record.size > rest
+                               ? 0
+                               : sizeof(record) +
+                                     ((record.size + 7) & ~size_t(7));
+        if (end == 0 || end > mapped - store_indexed_) {
+            // Still being written by another process, or torn. Appends do
+            // not interleave, so it is torn once a record starts within it.
+            StoreRecord next;
+            const size_t found = FindRecord(data, mapped, store_indexed_ + 1);
+            if (!RecordAt(data, mapped, found, &next)) break;
+            store_indexed_ = found;
+            continue;
+        }
+        if (mapped - store_indexed_ - end >= sizeof(kRecordMagic) &&
+            std::memcmp(data + store_indexed_ + end, kRecordMagic,
+                        sizeof(kRecordMagic)) != 0) {
+            // Torn, and its size runs into the records after it.
+            store_indexed_ = FindRecord(data, mapped, store_indexed_ + 1);
+            continue;
+        }
+        Key key;
+        std::memcpy(key.words, record.key, sizeof(key.words));
+        store_index_[key] = store_indexed_;
+        store_indexed_ += end;
+    }
+    return true;
+}
+
+bool DiffCache::Find(const Key &key, std::string *diff) {
+    const auto found = memory_.find(key);
+    if (found != memory_.end()) {
+        entries_.splice(entries_.begin(), entries_, found->second);
+        *diff = found->second->diff;
+        ++stats_.memory_hits;
+        return true;
+    }
+    if (store_fd_ < 0) return false;
+    auto stored = store_index_.find(key);
+    if (stored == store_index_.end()) {
+        // Another process may have stored it since.
+        if (!IndexStore()) return false;
+        stored = store_index_.find(key);
+        if (stored == store_index_.end()) return false;
+    }
+    const char *data = static_cast<const char *>(store_mapping_);
+    StoreRecord record;
+    std::memcpy(&record, data + stored->second, sizeof(record));
+    const std::string_view text(data + stored->second + sizeof(record),
+                                record.size);
+    const ContentHash hash = HashText(text);
+    if (hash.low != record.diff_low || hash.high != record.diff_high) {
+        // Torn or overwritten: forget it, so that the diff is stored again.
+        store_index_.erase(stored);
+        return false;
+    }
+    diff->assign(text.data(), text.size());
+    ++stats_.disk_hits;
+    Remember(key, *diff);
+    return true;
+}
+
+void DiffCache::Remember(const Key &key, const std::string &diff) {
+    const size_t cost = diff.size() + sizeof(Entry) + kEntryOverhead;
+    if (cost > capacity_ || memory_.count(key) > 0) return;
+    Entry entry;
+    entry.key = key;
+    entry.diff = diff;
+    entries_.push_front(std::move(entry));
+    memory_[key] = entries_.begin();
+    stats_.memory_bytes += cost;
+    ++stats_.entries;
+    while (stats_.memory_bytes > capacity_) {
+        const Entry &last = entries_.back();
+        stats_.memory_bytes -= last.diff.size() + sizeof(Entry) +
+                               kEntryOverhead;
+        --stats_.entries;
+        ++stats_.evictions;
+        memory_.erase(last.key);
+        entries_.pop_back();
+    }
+}
+
+void DiffCache::Store(const Key &key, const std::string &diff) {
+    if (!store_writable_ || store_index_.count(key) > 0) return;
+    StoreRecord record;
+    std::memcpy(record.magic, kRecordMagic, sizeof(record.magic));
+    std::memcpy(record.key, key.words, sizeof(record.key));
+    record.size = diff.size();
+    const ContentHash hash = HashText(diff);
+    record.diff_low = hash.low;
+    record.diff_high = hash.high;
+    record.check = RecordCheck(record);
+    static const char kPadding[8] = {0};
+    struct iovec vectors[3];
+    vectors[0].iov_base = &record;
+    vectors[0].iov_len = sizeof(record);
+    vectors[1].iov_base = const_cast<char *>(diff.data());
+    vectors[1].iov_len = diff.size();
+    vectors[2].iov_base = const_cast<char *>(kPadding);
+    vectors[2].iov_len = (8 - diff.size() % 8) % 8;
+    // One write, so that the record is not interleaved with those of other
+    // processes. The store is only a cache: a failed write loses the
+    // record. A short one leaves it torn, and as the file system is likely
+    // full, no more records are appended.
+    const ssize_t written = writev(store_fd_, vectors, 3);
+    if (written != static_cast<ssize_t>(sizeof(record) + diff.size() +
+                                        vectors[2].iov_len)) {
+        store_writable_ = false;
+    }
+}
+
+template <typename Line>
+std::string DiffCache::CreateUnifiedDiffOf(const std::vector<Line> &left,
+                                           const std::vector<Line> &right,
+                                           const DiffOptions &options) {
+    const ContentHash left_hash = HashLines(left);
+    const ContentHash right_hash = HashLines(right);
+    Key key;
+    key.words[0] = left_hash.low;
+    key.words[1] = left_hash.high;
+    key.words[2] = right_hash.low;
+    key.words[3] = right_hash.high;
+    key.words[4] = options.context;
+    key.words[5] = static_cast<uint64_t>(options.algorithm) |
+                   static_cast<uint64_t>(options.reduce) << 8 |
+                   static_cast<uint64_t>(options.intraline) << 16 |
+                   static_cast<uint64_t>(options.check_sorted) << 24;
+    std::string diff;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (Find(key, &diff)) return diff;
+        ++stats_.misses;
+    }
+    WriteUnifiedDiff(left, right, options, [&diff](std::string_view block) {
+        diff.append(block.data(), block.size());
+    });
+    std::lock_guard<std::mutex> lock(mutex_);
+    Remember(key, diff);
+    Store(key, diff);
+    return diff;
+}
+
+std::string DiffCache::CreateUnifiedDiff(const std::vector<std::string> &left,
+                                         const std::vector<std::string> &right,
+                                         const DiffOptions &options) {
+    return CreateUnifiedDiffOf(left, right, options);
+}
+
+std::string DiffCache::CreateUnifiedDiff(
+    const std::vector<std::string_view> &left,
+    const std::vector<std::string_view> &right, const DiffOptions &options) {
+    return CreateUnifiedDiffOf(left, right, options);
+}
+
+DiffCacheStats DiffCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void DiffCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    memory_.clear();
+    stats_.memory_bytes = 0;
+    stats_.entries = 0;
+}
+
+}  // namespace edit_distance
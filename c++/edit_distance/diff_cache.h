@@ -0,0 +1,148 @@
+#ifndef EDIT_DISTANCE_DIFF_CACHE_H
+#define EDIT_DISTANCE_DIFF_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "edit_distance.h"
+
+namespace edit_distance {
+// 128-bit hash of a sequence of lines, MurmurHash3 style: each line is
+// mixed 16 bytes at a time, then its length, so that no two sequences of
+// lines feed the same bytes. Not cryptographic: inputs that are crafted to
+// collide can.
+struct ContentHash {
+    uint64_t low, high;
+};
+
+ContentHash HashLines(const std::vector<std::string> &lines);
+ContentHash HashLines(const std::vector<std::string_view> &lines);
+
+// Counters of a DiffCache.
+struct DiffCacheStats {
+    DiffCacheStats()
+        : memory_hits(0),
+          disk_hits(0),
+          misses(0),
+          evictions(0),
+          memory_bytes(0),
+          entries(0) {}
+
+    // Diffs found in memory, in the store, and computed.
+    size_t memory_hits, disk_hits, misses;
+    // Diffs dropped from memory to stay within the capacity.
+    size_t evictions;
+    // Bytes of the diffs in memory, with the cost of their entries, and
+    // their number.
+    size_t memory_bytes, entries;
+};
+
+// CreateUnifiedDiff behind a cache. A diff is keyed by the ContentHash of
+// both sides, the context, and the other options that change the output:
+// algorithm, reduce, intraline and check_sorted. A hit costs the hashing of
+// the lines and a copy of the diff; both are linear in bytes and far below
+// any diff, so a repeated diff of small files returns in microseconds.
+//
+// The diffs stay in memory in LRU order, up to 'capacity' bytes. With a
+// store (see OpenStore), the computed diffs are also appended to a file
+// that is mapped for lookups, so they outlive the process and are shared
+// with the other processes that open the same file.
+//
+// Safe to use from several threads; diffs are computed outside the lock,
+// so two threads that miss on the same key both compute it.
+class DiffCache {
+   public:
+    explicit DiffCache(size_t capacity);
+    ~DiffCache();
+
+    // Opens the store at 'path', creating it when it does not exist, and
+    // indexes its diffs. The store only grows: remove the file to empty it.
+    // Appends are single writes to a file opened with O_APPEND, so
+    // processes can share a store. A record torn by a crash or a full disk,
+    // or garbage, is skipped up to the next record; a record that ends past
+    // the end of the file is taken as still being written until a record
+    // starts after it. After a short write of its own, the cache stops
+    // appending. Returns false, with errno set, when the file cannot be
+    // opened or mapped or is not a store.
+    bool OpenStore(const char *path);
+
+    std::string CreateUnifiedDiff(const std::vector<std::string> &left,
+                                  const std::vector<std::string> &right,
+                                  const DiffOptions &options = DiffOptions());
+    std::string CreateUnifiedDiff(const std::vector<std::string_view> &left,
+                                  const std::vector<std::string_view> &right,
+                                  const DiffOptions &options = DiffOptions());
+
+    DiffCacheStats stats() const;
+
+    // Drops the diffs in memory. The store and the counters are kept.
+    void Clear();
+
+   private:
+    DiffCache(const DiffCache &);
+    DiffCache &operator=(const DiffCache &);
+
+    // The key of a diff: both hashes, the context and the other options.
+    struct Key {
+        uint64_t words[6];
+
+        bool operator==(const Key &other) const;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const {
+            return static_cast<size_t>(key.words[0] ^ key.words[2]);
+        }
+    };
+    struct Entry {
+        Key key;
+        std::string diff;
+    };
+    typedef std::list<Entry> Entries;
+
+    template <typename Line>
+    std::string CreateUnifiedDiffOf(const std::vector<Line> &left,
+                                    const std::vector<Line> &right,
+                                    const DiffOptions &options);
+
+    // Finds the diff of 'key' in memory or in the store, moving it to the
+    // front of the LRU. A stored diff that fails its hash is forgotten.
+    // Called with the lock held.
+    bool Find(const Key &key, std::string *diff);
+    // Indexes the records appended to the store since the last call.
+    // Called with the lock held.
+    bool IndexStore();
+    // Adds a diff to memory, evicting the least recently used ones. Called
+    // with the lock held.
+    void Remember(const Key &key, const std::string &diff);
+    // Appends a record to the store. Called with the lock held.
+    void Store(const Key &key, const std::string &diff);
+    void CloseStore();
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    DiffCacheStats stats_;
+    // Front is the most recently used.
+    Entries entries_;
+    std::unordered_map<Key, Entries::iterator, KeyHash> memory_;
+
+    // The store: its descriptor, its mapping, the offset of each record,
+    // the end of the indexed records, and whether to append to it.
+    int store_fd_;
+    void *store_mapping_;
+    size_t store_mapping_size_;
+    std::unordered_map<Key, size_t, KeyHash> store_index_;
+    size_t store_indexed_;
+    bool store_writable_;
+};
+
+}  // namespace edit_distance
+
+#endif  // EDIT_DISTANCE_DIFF_CACHE_H
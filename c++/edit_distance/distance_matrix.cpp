@@ -0,0 +1,297 @@
+#include "distance_matrix.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "edit_distance.h"
+
+// Same switch as in edit_distance.cpp: define EDIT_DISTANCE_DISABLE_AVX2 to
+// build the scalar code only.
+#if !defined(EDIT_DISTANCE_DISABLE_AVX2) && defined(__x86_64__) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define EDIT_DISTANCE_USE_AVX2 1
+#include <immintrin.h>
+#define EDIT_DISTANCE_AVX2 __attribute__((target("avx2")))
+#else
+#define EDIT_DISTANCE_USE_AVX2 0
+#endif
+
+namespace edit_distance {
+// Pairs compared at once, one per 64-bit lane of an AVX2 register.
+const size_t kBatchLanes = 4;
+// Rows of the matrix handed to a thread at a time.
+const size_t kMatrixChunk = 8;
+
+// The strings by rank, i.e. by increasing length, in groups of kBatchLanes
+// with their bytes interleaved, so that the bytes a batch reads at one
+// column are adjacent. Built once and read by all the threads.
+struct RankGroups {
+    // texts[offsets[g] + j * kBatchLanes + lane] is byte j of the string of
+    // rank g * kBatchLanes + lane, or 256 past its end.
+    std::vector<uint16_t> texts;
+    std::vector<size_t> offsets;
+    // The lengths by rank, 0 past the last rank.
+    std::vector<int64_t> lengths;
+
+    RankGroups(const std::vector<std::string_view> &strings,
+               const std::vector<size_t> &order) {
+        const size_t groups = (order.size() + kBatchLanes - 1) / kBatchLanes;
+        lengths.assign(groups * kBatchLanes, 0);
+        offsets.assign(groups + 1, 0);
+        for (size_t rank = 0; rank < order.size(); ++rank) {
+            lengths[rank] = strings[order[rank]].size();
+        }
+        for (size_t g = 0; g < groups; ++g) {
+            offsets[g + 1] =
+                offsets[g] +
+                *std::max_element(&lengths[g * kBatchLanes],
+                                  &lengths[(g + 1) * kBatchLanes]) *
+                    kBatchLanes;
+        }
+        texts.assign(offsets[groups], 256);
+        for (size_t rank = 0; rank < order.size(); ++rank) {
+            const std::string_view str = strings[order[rank]];
+            uint16_t *text = &texts[offsets[rank / kBatchLanes]];
+            for (size_t j = 0; j < str.size(); ++j) {
+                text[j * kBatchLanes + rank % kBatchLanes] =
+                    static_cast<unsigned char>(str[j]);
+            }
+        }
+    }
+};
+
+// The state of one thread of DistanceMatrix. Row k of the work compares the
+// string of rank k with those of the ranks after it, so that each pair is
+// done once and the strings of a batch have about the same length.
+class MatrixWorker {
+   public:
+    MatrixWorker(const std::vector<std::string_view> &strings,
+                 const std::vector<size_t> &order, const RankGroups *groups,
+                 uint32_t *matrix)
+        : strings_(strings), order_(order), groups_(groups), matrix_(matrix) {}
+
+    void Row(size_t k) {
+        const std::string_view str = strings_[order_[k]];
+        size_t rank = k + 1;
+#if EDIT_DISTANCE_USE_AVX2
+        if (groups_ && !str.empty()) {
+            const size_t words = (str.size() + 63) / 64;
+            // Row 256 stays 0 for the lanes past the end of their string.
+            peq_.assign(257 * words, 0);
+            for (size_t i = 0; i < str.size(); ++i) {
+                peq_[static_cast<unsigned char>(str[i]) * words + i / 64] |=
+                    uint64_t(1) << (i % 64);
+            }
+            for (size_t g = rank / kBatchLanes; g * kBatchLanes < order_.size();
+                 ++g) {
+                Batch(k, str, g);
+            }
+            rank = order_.size();
+        }
+#endif
+        for (; rank < order_.size(); ++rank) {
+            Store(k, rank, Distance(str, strings_[order_[rank]]));
+        }
+    }
+
+   private:
+    void Store(size_t k, size_t rank, size_t distance) {
+        const size_t i = order_[k], j = order_[rank];
+        matrix_[CondensedIndex(order_.size(), std::min(i, j),
+                               std::max(i, j))] =
+            static_cast<uint32_t>(distance);
+    }
+
+#if EDIT_DISTANCE_USE_AVX2
+    // Compares 'str', the string of rank k, with the strings of group 'g'
+    // after it, one per 64-bit lane. This is the bit-parallel DP of
+    // Distance() with 'str' as the pattern, whose match masks in peq_ serve
+    // the whole row; a lane stops counting once its string is over.
+    EDIT_DISTANCE_AVX2 void Batch(size_t k, std::string_view str, size_t g) {
+        const size_t words = (str.size() + 63) / 64;
+        const size_t first = g * kBatchLanes;
+        const uint16_t *texts = &groups_->texts[groups_->offsets[g]];
+        const size_t longest =
+            (groups_->offsets[g + 1] - groups_->offsets[g]) / kBatchLanes;
+        // The lanes of rank k and before take no part.
+        alignas(32) int64_t lengths[kBatchLanes];
+        for (size_t lane = 0; lane < kBatchLanes; ++lane) {
+            lengths[lane] =
+                first + lane > k ? groups_->lengths[first + lane] : 0;
+        }
+
+        const __m256i one = _mm256_set1_epi64x(1);
+        const __m256i ones = _mm256_set1_epi64x(-1);
+        const __m256i last =
+            _mm256_set1_epi64x(int64_t(1) << ((str.size() - 1) % 64));
+        const __m256i lengths_v =
+            _mm256_load_si256(reinterpret_cast<const __m256i *>(lengths));
+        __m256i distance = _mm256_set1_epi64x(str.size());
+        if (words == 1) {
+            // The common case, with the deltas kept in registers.
+            __m256i vp = ones, vn = _mm256_setzero_si256();
+            for (size_t j = 0; j < longest; ++j) {
+                const uint16_t *text = &texts[j * kBatchLanes];
+                const __m256i eq =
+                    _mm256_set_epi64x(peq_[text[3]], peq_[text[2]],
+                                      peq_[text[1]], peq_[text[0]]);
+                const __m256i active =
+                    _mm256_cmpgt_epi64(lengths_v, _mm256_set1_epi64x(j));
+                const __m256i d0 = _mm256_or_si256(
+                    _mm256_or_si256(
+                        _mm256_xor_si256(
+                            _mm256_add_epi64(_mm256_and_si256(eq, vp), vp),
+                            vp),
+                        eq),
+                    vn);
+                __m256i hp = _mm256_or_si256(
+                    vn, _mm256_andnot_si256(_mm256_or_si256(d0, vp), ones));
+                __m256i hn = _mm256_and_si256(d0, vp);
+                // cmpeq gives -1 where the last row moves.
+                distance = _mm256_sub_epi64(
+                    distance,
+                    _mm256_and_si256(
+                        active, _mm256_cmpeq_epi64(_mm256_and_si256(hp, last),
+                                                   last)));
+                distance = _mm256_add_epi64(
+                    distance,
+                    _mm256_and_si256(
+                        active, _mm256_cmpeq_epi64(_mm256_and_si256(hn, last),
+                                                   last)));
+                hp = _mm256_or_si256(_mm256_slli_epi64(hp, 1), one);
+                hn = _mm256_slli_epi64(hn, 1);
+                vp = _mm256_or_si256(
+                    hn, _mm256_andnot_si256(_mm256_or_si256(d0, hp), ones));
+                vn = _mm256_and_si256(hp, d0);
+            }
+        } else {
+            vp_.assign(words * kBatchLanes, ~uint64_t(0));
+            vn_.assign(words * kBatchLanes, 0);
+            for (size_t j = 0; j < longest; ++j) {
+                const uint16_t *text = &texts[j * kBatchLanes];
+                const __m256i active =
+                    _mm256_cmpgt_epi64(lengths_v, _mm256_set1_epi64x(j));
+                __m256i hp_carry = one, hn_carry = _mm256_setzero_si256();
+                for (size_t w = 0; w < words; ++w) {
+                    // A -1 entering from the word above acts like a match
+                    // on its first row.
+                    const __m256i eq = _mm256_or_si256(
+                        _mm256_set_epi64x(peq_[text[3] * words + w],
+                                          peq_[text[2] * words + w],
+                                          peq_[text[1] * words + w],
+                                          peq_[text[0] * words + w]),
+                        hn_carry);
+                    __m256i *vp_w =
+                        reinterpret_cast<__m256i *>(&vp_[w * kBatchLanes]);
+                    __m256i *vn_w =
+                        reinterpret_cast<__m256i *>(&vn_[w * kBatchLanes]);
+                    const __m256i vp = _mm256_loadu_si256(vp_w);
+                    const __m256i vn = _mm256_loadu_si256(vn_w);
+                    const __m256i d0 = _mm256_or_si256(
+                        _mm256_or_si256(
+                            _mm256_xor_si256(
+                                _mm256_add_epi64(_mm256_and_si256(eq, vp),
+                                                 vp),
+                                vp),
+                            eq),
+                        vn);
+                    __m256i hp = _mm256_or_si256(
+                        vn,
+                        _mm256_andnot_si256(_mm256_or_si256(d0, vp), ones));
+                    __m256i hn = _mm256_and_si256(d0, vp);
+                    const __m256i hp_in = hp_carry, hn_in = hn_carry;
+                    if (w + 1 < words) {
+                        hp_carry = _mm256_srli_epi64(hp, 63);
+                        hn_carry = _mm256_srli_epi64(hn, 63);
+                    } else {
+                        distance = _mm256_sub_epi64(
+                            distance,
+                            _mm256_and_si256(
+                                active, _mm256_cmpeq_epi64(
+                                            _mm256_and_si256(hp, last), last)));
+                        distance = _mm256_add_epi64(
+                            distance,
+                            _mm256_and_si256(
+                                active, _mm256_cmpeq_epi64(
+                                            _mm256_and_si256(hn, last), last)));
+                    }
+                    hp = _mm256_or_si256(_mm256_slli_epi64(hp, 1), hp_in);
+                    hn = _mm256_or_si256(_mm256_slli_epi64(hn, 1), hn_in);
+                    _mm256_storeu_si256(
+                        vp_w,
+                        _mm256_or_si256(
+                            hn, _mm256_andnot_si256(_mm256_or_si256(d0, hp),
+                                                    ones)));
+                    _mm256_storeu_si256(vn_w, _mm256_and_si256(hp, d0));
+                }
+            }
+        }
+
+        alignas(32) int64_t distances[kBatchLanes];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(distances), distance);
+        for (size_t lane = 0; lane < kBatchLanes; ++lane) {
+            const size_t rank = first + lane;
+            if (rank > k && rank < order_.size()) {
+                Store(k, rank, distances[lane]);
+            }
+        }
+    }
+#endif  // EDIT_DISTANCE_USE_AVX2
+
+    const std::vector<std::string_view> &strings_;
+    const std::vector<size_t> &order_;
+    // NULL without AVX2.
+    const RankGroups *groups_;
+    uint32_t *matrix_;
+    // The match masks of the pattern, as in Distance(), and the vertical
+    // deltas of the lanes, word by word.
+    std::vector<uint64_t> peq_, vp_, vn_;
+};
+
+std::vector<uint32_t> DistanceMatrix(
+    const std::vector<std::string_view> &strings, size_t threads) {
+    const size_t n = strings.size();
+    std::vector<uint32_t> matrix(n < 2 ? 0 : n * (n - 1) / 2);
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&strings](size_t a, size_t b) {
+                         return strings[a].size() < strings[b].size();
+                     });
+
+    std::unique_ptr<RankGroups> groups;
+#if EDIT_DISTANCE_USE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        groups.reset(new RankGroups(strings, order));
+    }
+#endif
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max<size_t>(1, std::min(threads, n / kMatrixChunk));
+
+    std::atomic<size_t> next_chunk(0);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.push_back(std::thread([&]() {
+            MatrixWorker worker(strings, order, groups.get(), matrix.data());
+            for (size_t begin; (begin = kMatrixChunk * next_chunk++) < n;) {
+                const size_t end = std::min(n, begin + kMatrixChunk);
+                for (size_t k = begin; k < end; ++k) worker.Row(k);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads; ++t) pool[t].join();
+    return matrix;
+}
+
+std::vector<uint32_t> DistanceMatrix(const std::vector<std::string> &strings,
+                                     size_t threads) {
+    return DistanceMatrix(
+        std::vector<std::string_view>(strings.begin(), strings.end()),
+        threads);
+}
+
+}  // namespace edit_distance
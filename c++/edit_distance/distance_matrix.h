@@ -0,0 +1,37 @@
+#ifndef EDIT_DISTANCE_DISTANCE_MATRIX_H
+#define EDIT_DISTANCE_DISTANCE_MATRIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace edit_distance {
+// Position of the pair (i, j), i < j, in the condensed matrix of 'n'
+// strings: the upper triangle row by row, as scipy's pdist lays it out.
+inline size_t CondensedIndex(size_t n, size_t i, size_t j) {
+    return n * i - i * (i + 1) / 2 + (j - i - 1);
+}
+
+// Returns the Distance() of every pair of 'strings', as a condensed matrix
+// of n * (n - 1) / 2 entries (see CondensedIndex).
+//
+// Meant for many short strings, e.g. for clustering. With AVX2, one string
+// is compared with 4 others at a time, one per 64-bit lane, by the
+// bit-parallel DP of Distance(); its match masks are built once for all the
+// pairs of the string. The strings are sorted by length so that the 4 in a
+// batch have about the same length. Without AVX2 each pair goes through
+// Distance(). The rows of the matrix are spread over 'threads' threads, 0
+// for all the hardware threads.
+std::vector<uint32_t> DistanceMatrix(
+    const std::vector<std::string_view> &strings, size_t threads);
+
+// Same as above, for strings.
+std::vector<uint32_t> DistanceMatrix(const std::vector<std::string> &strings,
+                                     size_t threads);
+
+}  // namespace edit_distance
+
+#endif  // EDIT_DISTANCE_DISTANCE_MATRIX_H
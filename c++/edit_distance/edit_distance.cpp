@@ -0,0 +1,2978 @@
+/* Copied from google-test
+ */
+
+#include "edit_distance.h"
+#include "cost_policy.h"
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cctype>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <utility>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The Wagner-Fischer DP has an AVX2 kernel, picked at run time when the CPU
+// supports it. Define EDIT_DISTANCE_DISABLE_AVX2 to build the scalar code
+// only.
+#if !defined(EDIT_DISTANCE_DISABLE_AVX2) && defined(__x86_64__) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define EDIT_DISTANCE_USE_AVX2 1
+#include <immintrin.h>
+#define EDIT_DISTANCE_AVX2 __attribute__((target("avx2")))
+#else
+#define EDIT_DISTANCE_USE_AVX2 0
+#endif
+
+namespace edit_distance {
+// Traceback matrix of a rows x cols DP, one EditType per cell packed in
+// 2 bits, row-major and contiguous. Rows are padded to whole words so that
+// they can be written one word at a time. Row 0 and column 0 of the DP are
+// not stored since they are always kAdd and kRemove.
+class PackedMoves {
+   public:
+    static const size_t kCellsPerWord = 32;
+
+    PackedMoves(size_t rows, size_t cols)
+        : row_words_((cols + kCellsPerWord - 1) / kCellsPerWord),
+          words_(&own_words_) {
+        words_->resize(rows * row_words_);
+    }
+
+    // Same as above, in the memory of 'buffer', which must outlive this.
+    PackedMoves(size_t rows, size_t cols, std::vector<uint64_t> *buffer)
+        : row_words_((cols + kCellsPerWord - 1) / kCellsPerWord),
+          words_(buffer) {
+        words_->resize(rows * row_words_);
+        std::memset(words_->data(), 0, words_->size() * sizeof(uint64_t));
+    }
+
+    // Storage for DP row l_i + 1, holding cells r_i + 1 for r_i in
+    // [0, cols).
+    uint64_t *row(size_t l_i) { return words_->data() + l_i * row_words_; }
+
+    // Returns the move of DP cell (l_i, r_i).
+    EditType Get(size_t l_i, size_t r_i) const {
+        if (l_i == 0) return kAdd;
+        if (r_i == 0) return kRemove;
+        const size_t cell = r_i - 1;
+        const uint64_t word =
+            (*words_)[(l_i - 1) * row_words_ + cell / kCellsPerWord];
+        return static_cast<EditType>((word >> (cell % kCellsPerWord * 2)) & 3);
+    }
+
+   private:
+    PackedMoves(const PackedMoves &);
+    PackedMoves &operator=(const PackedMoves &);
+
+    size_t row_words_;
+    std::vector<uint64_t> own_words_;
+    std::vector<uint64_t> *words_;
+};
+
+// A slot of the hash table of InternalStrings.
+struct InternSlot {
+    InternSlot() : tag(0), id(0) {}
+    uint32_t tag;  // High half of the hash.
+    uint32_t id;   // Id plus one, 0 for an empty slot.
+};
+
+// The buffers of a Workspace. Each one only grows, and is used by one
+// function at a time: the caller of a function that takes the buffers does
+// not hold the ones it uses.
+struct Workspace::Buffers {
+    // Wagner-Fischer: the first row and column, two rows of costs and the
+    // traceback.
+    std::vector<Cost> boundary, costs;
+    std::vector<uint64_t> moves;
+    // The ids of lines, which the reduction also compacts in place, and
+    // their intern table.
+    std::vector<size_t> left_ids, right_ids;
+    std::vector<InternSlot> slots;
+    std::vector<uint32_t> positions;
+    // Distance: the match masks, all 0 between the calls so that a call
+    // only touches the words of its pattern, the vertical deltas, and the
+    // pattern symbols and text of the id version.
+    std::vector<uint64_t> peq, deltas;
+    std::vector<size_t> symbols;
+    std::vector<uint32_t> dense_text;
+};
+
+Workspace::Workspace() : buffers_(new Buffers) {}
+
+Workspace::~Workspace() { delete buffers_; }
+
+void Workspace::Clear() { *buffers_ = Buffers(); }
+
+// Returns the buffers of 'workspace', or of the thread's own workspace when
+// it is NULL.
+Workspace::Buffers *GetBuffers(Workspace *workspace) {
+    static thread_local Workspace thread_workspace;
+    return (workspace ? workspace : &thread_workspace)->buffers_;
+}
+
+// Computes one DP row for the left element 'left_id' from the previous row
+// 'prev', with row[0] already set, and writes its moves to 'out', one word
+// per 32 cells.
+inline void FillRow(size_t left_id, const size_t *right, size_t cols,
+                    const Cost *prev, Cost *row, Cost unit, uint64_t *out) {
+    uint64_t word = 0;
+    for (size_t r_i = 0; r_i < cols; ++r_i) {
+        const EditType move =
+            ChooseMove(left_id == right[r_i], row[r_i], prev[r_i + 1],
+                       prev[r_i], unit, &row[r_i + 1]);
+        const size_t bit = r_i % PackedMoves::kCellsPerWord * 2;
+        word |= static_cast<uint64_t>(move) << bit;
+        if (bit == 62 || r_i + 1 == cols) {
+            out[r_i / PackedMoves::kCellsPerWord] = word;
+            word = 0;
+        }
+    }
+}
+
+// Runs the DP over left[0, rows) x right[0, cols), starting from the given
+// first row and column costs, and fills 'moves'. Only two rows of costs are
+// kept alive, in 'costs'.
+void FillMoves(const size_t *left, size_t rows, const size_t *right,
+               size_t cols, const Cost *top, const Cost *side, Cost unit,
+               PackedMoves *moves, std::vector<Cost> *costs) {
+    costs->resize(2 * (cols + 1));
+    Cost *prev = costs->data(), *row = prev + cols + 1;
+    std::copy(top, top + cols + 1, prev);
+    for (size_t l_i = 0; l_i < rows; ++l_i) {
+        row[0] = side[l_i + 1];
+        FillRow(left[l_i], right, cols, prev, row, unit, moves->row(l_i));
+        std::swap(prev, row);
+    }
+}
+
+// The edit scripts are built by appending to a 'Script': either a
+// std::vector<EditType>, one edit per element, or a std::vector<EditRun>,
+// where an edit equal to the last one only grows its run.
+inline void AppendEdit(EditType edit, std::vector<EditType> *edits) {
+    edits->push_back(edit);
+}
+
+inline void AppendEdit(EditType edit, std::vector<EditRun> *runs) {
+    if (!runs->empty() && runs->back().type == edit) {
+        ++runs->back().count;
+    } else {
+        runs->push_back(EditRun(edit, 1));
+    }
+}
+
+// Appends 'count' times 'edit'.
+inline void AppendRun(EditType edit, size_t count,
+                      std::vector<EditType> *edits) {
+    edits->insert(edits->end(), count, edit);
+}
+
+inline void AppendRun(EditType edit, size_t count, std::vector<EditRun> *runs) {
+    if (count == 0) return;
+    if (!runs->empty() && runs->back().type == edit) {
+        runs->back().count += count;
+    } else {
+        runs->push_back(EditRun(edit, count));
+    }
+}
+
+// Makes room for a script of up to 'size' edits. The runs of a script are
+// usually far fewer, so they grow as needed.
+inline void ReserveScript(size_t size, std::vector<EditType> *edits) {
+    edits->reserve(size);
+}
+
+inline void ReserveScript(size_t, std::vector<EditRun> *) {}
+
+// Appends the edits of 'edits' to 'script'.
+inline void AppendScript(const std::vector<EditType> &edits,
+                         std::vector<EditType> *script) {
+    script->insert(script->end(), edits.begin(), edits.end());
+}
+
+inline void AppendScript(const std::vector<EditType> &edits,
+                         std::vector<EditRun> *script) {
+    for (size_t i = 0; i < edits.size(); ++i) AppendEdit(edits[i], script);
+}
+
+inline void AppendScript(const std::vector<EditRun> &runs,
+                         std::vector<EditRun> *script) {
+    for (size_t i = 0; i < runs.size(); ++i) {
+        AppendRun(runs[i].type, runs[i].count, script);
+    }
+}
+
+// Appends to 'reversed_path' the traceback from (rows, cols) to (0, 0).
+template <typename Moves, typename Script>
+void AppendTraceback(const Moves &moves, size_t rows, size_t cols,
+                     Script *reversed_path) {
+    for (size_t l_i = rows, r_i = cols; l_i > 0 || r_i > 0;) {
+        EditType move = moves.Get(l_i, r_i);
+        AppendEdit(move, reversed_path);
+        l_i -= move != kAdd;
+        r_i -= move != kRemove;
+    }
+}
+
+#if EDIT_DISTANCE_USE_AVX2
+// Traceback matrix of a rows x cols DP stored by anti-diagonal, 2 bits per
+// cell. Diagonal d = l_i + r_i holds its cells in increasing l_i order, in
+// chunks of 8 cells starting at the beginning of the diagonal, so that a
+// vector of adjacent cells is written as one chunk.
+class DiagonalMoves {
+   public:
+    static const size_t kCellsPerChunk = 8;
+
+    DiagonalMoves(size_t rows, size_t cols)
+        : rows_(rows), cols_(cols), offsets_(rows + cols + 2) {
+        size_t chunks = 0;
+        for (size_t d = 2; d <= rows + cols; ++d) {
+            offsets_[d] = chunks;
+            chunks += (last(d) - first(d) + kCellsPerChunk) / kCellsPerChunk;
+        }
+        chunks_.resize(chunks);
+    }
+
+    // Range of l_i for the cells of diagonal d with l_i, r_i >= 1.
+    size_t first(size_t d) const { return d > cols_ ? d - cols_ : 1; }
+    size_t last(size_t d) const { return std::min(rows_, d - 1); }
+
+    // Chunks of diagonal d; chunk k holds cells first(d) + 8k onwards.
+    uint16_t *diagonal(size_t d) { return &chunks_[offsets_[d]]; }
+
+    EditType Get(size_t l_i, size_t r_i) const {
+        if (l_i == 0) return kAdd;
+        if (r_i == 0) return kRemove;
+        const size_t d = l_i + r_i, cell = l_i - first(d);
+        const uint16_t chunk = chunks_[offsets_[d] + cell / kCellsPerChunk];
+        return static_cast<EditType>((chunk >> (cell % kCellsPerChunk * 2)) &
+                                     3);
+    }
+
+   private:
+    size_t rows_, cols_;
+    std::vector<size_t> offsets_;
+    std::vector<uint16_t> chunks_;
+};
+
+// AVX2 lanes for FillDiagonalMoves. The costs are signed so that cmpgt can
+// compare them; 32-bit lanes are used whenever the largest cost fits.
+struct Avx2Lanes32 {
+    typedef int32_t Value;
+    static const size_t kLanes = 8;
+    EDIT_DISTANCE_AVX2 static __m256i Load(const Value *p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+    EDIT_DISTANCE_AVX2 static __m256i LoadIds(const uint32_t *p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+    EDIT_DISTANCE_AVX2 static void Store(Value *p, __m256i v) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+    }
+    EDIT_DISTANCE_AVX2 static __m256i Set1(Value v) {
+        return _mm256_set1_epi32(v);
+    }
+    EDIT_DISTANCE_AVX2 static __m256i Add(__m256i a, __m256i b) {
+        return _mm256_add_epi32(a, b);
+    }
+    EDIT_DISTANCE_AVX2 static __m256i Equal(__m256i a, __m256i b) {
+        return _mm256_cmpeq_epi32(a, b);
+    }
+    EDIT_DISTANCE_AVX2 static __m256i Greater(__m256i a, __m256i b) {
+        return _mm256_cmpgt_epi32(a, b);
+    }
+    EDIT_DISTANCE_AVX2 static unsigned Mask(__m256i v) {
+        return static_cast<unsigned>(
+            _mm256_movemask_ps(_mm256_castsi256_ps(v)));
+    }
+};
+
+struct Avx2Lanes64 {
+    typedef int64_t Value;
+    static const size_t kLanes = 4;
+    EDIT_DISTANCE_AVX2 static __m256i Load(const Value *p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+    EDIT_DISTANCE_AVX2 static __m256i LoadIds(const uint32_t *p) {
+        return _mm256_cvtepu32_epi64(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    }
+    EDIT_DISTANCE_AVX2 static void Store(Value *p, __m256i v) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+    }
+    EDIT_DISTANCE_AVX2 static __m256i Set1(Value v) {
+        return _mm256_set1_epi64x(v);
+    }
+    EDIT_DISTANCE_AVX2 static __m256i Add(__m256i a, __m256i b) {
+        return _mm256_add_epi64(a, b);
+    }
+    EDIT_DISTANCE_AVX2 static __m256i Equal(__m256i a, __m256i b) {
+        return _mm256_cmpeq_epi64(a, b);
+    }
+    EDIT_DISTANCE_AVX2 static __m256i Greater(__m256i a, __m256i b) {
+        return _mm256_cmpgt_epi64(a, b);
+    }
+    EDIT_DISTANCE_AVX2 static unsigned Mask(__m256i v) {
+        return static_cast<unsigned>(
+            _mm256_movemask_pd(_mm256_castsi256_pd(v)));
+    }
+};
+
+// Spreads the 8 bits of the index to the even bits of the result.
+struct SpreadBitsTable {
+    uint16_t values[256];
+    SpreadBitsTable() {
+        for (unsigned i = 0; i < 256; ++i) {
+            values[i] = 0;
+            for (unsigned bit = 0; bit < 8; ++bit) {
+                values[i] |=
+                    static_cast<uint16_t>(((i >> bit) & 1) << (2 * bit));
+            }
+        }
+    }
+};
+
+// Same DP as FillMoves, but every anti-diagonal is computed Lanes::kLanes
+// cells at a time: the cells of one anti-diagonal only depend on the two
+// previous ones. 'right_reversed' is 'right' back to front so that the ids
+// of adjacent cells are adjacent in memory. The vector code applies the
+// exact ChooseMove rules lane-wise.
+// 'top' and 'side' are the first row and column of costs, as in FillMoves.
+// When not NULL, 'bottom' and 'right_edge' receive the last row and column.
+template <typename Lanes>
+EDIT_DISTANCE_AVX2 void FillDiagonalMoves(const uint32_t *left, size_t rows,
+                                          const uint32_t *right_reversed,
+                                          size_t cols, const Cost *top,
+                                          const Cost *side, Cost unit,
+                                          DiagonalMoves *moves, Cost *bottom,
+                                          Cost *right_edge) {
+    typedef typename Lanes::Value Value;
+    static const SpreadBitsTable spread;
+    const size_t kChunk = DiagonalMoves::kCellsPerChunk;
+    const Value add_cost = static_cast<Value>(unit);
+    const __m256i add_cost_v = Lanes::Set1(add_cost);
+    const __m256i replace_cost_v = Lanes::Set1(add_cost + 1);
+    const unsigned all_lanes = (1u << Lanes::kLanes) - 1;
+
+    // Costs of the diagonals d - 2, d - 1 and d, indexed by l_i.
+    std::vector<Value> before(rows + 1), prev(rows + 1), cur(rows + 1);
+    prev[0] = static_cast<Value>(top[0]);
+    if (cols > 0) cur[0] = static_cast<Value>(top[1]);
+    if (rows > 0) cur[1] = static_cast<Value>(side[1]);
+    if (bottom) bottom[0] = side[rows];
+    if (right_edge) right_edge[0] = top[cols];
+    for (size_t d = 2; d <= rows + cols; ++d) {
+        before.swap(prev);
+        prev.swap(cur);
+        if (d <= cols) cur[0] = static_cast<Value>(top[d]);
+        if (d <= rows) cur[d] = static_cast<Value>(side[d]);
+
+        const size_t first = moves->first(d), last = moves->last(d);
+        uint16_t *chunks = moves->diagonal(d);
+        size_t l_i = first;
+        for (; l_i + Lanes::kLanes - 1 <= last; l_i += Lanes::kLanes) {
+            const __m256i match =
+                Lanes::Equal(Lanes::LoadIds(left + l_i - 1),
+                             Lanes::LoadIds(right_reversed + cols - d + l_i));
+            const __m256i add = Lanes::Load(&prev[l_i]);
+            const __m256i remove = Lanes::Load(&prev[l_i - 1]);
+            const __m256i replace = Lanes::Load(&before[l_i - 1]);
+            const __m256i is_add = _mm256_and_si256(
+                Lanes::Greater(remove, add), Lanes::Greater(replace, add));
+            const __m256i is_remove = _mm256_and_si256(
+                Lanes::Greater(add, remove), Lanes::Greater(replace, remove));
+            __m256i cost = Lanes::Add(replace, replace_cost_v);
+            cost = _mm256_blendv_epi8(cost, Lanes::Add(add, add_cost_v),
+                                      is_add);
+            cost = _mm256_blendv_epi8(cost, Lanes::Add(remove, add_cost_v),
+                                      is_remove);
+            cost = _mm256_blendv_epi8(cost, replace, match);
+            Lanes::Store(&cur[l_i], cost);
+
+            // kMatch = 0, kAdd = 1, kRemove = 2, kReplace = 3.
+            const unsigned not_match = ~Lanes::Mask(match) & all_lanes;
+            const unsigned low = not_match & ~Lanes::Mask(is_remove);
+            const unsigned high = not_match & ~Lanes::Mask(is_add);
+            const size_t cell = l_i - first;
+            chunks[cell / kChunk] |= static_cast<uint16_t>(
+                (spread.values[low] | (spread.values[high] << 1))
+                << (cell % kChunk * 2));
+        }
+        for (; l_i <= last; ++l_i) {
+            Cost cost;
+            const EditType move = ChooseMove(
+                left[l_i - 1] == right_reversed[cols - d + l_i],
+                static_cast<Cost>(prev[l_i]), static_cast<Cost>(prev[l_i - 1]),
+                static_cast<Cost>(before[l_i - 1]), unit, &cost);
+            cur[l_i] = static_cast<Value>(cost);
+            const size_t cell = l_i - first;
+            chunks[cell / kChunk] |=
+                static_cast<uint16_t>(move << (cell % kChunk * 2));
+        }
+        if (bottom && d > rows && d - rows <= cols) {
+            bottom[d - rows] = static_cast<Cost>(cur[rows]);
+        }
+        if (right_edge && d > cols && d - cols <= rows) {
+            right_edge[d - cols] = static_cast<Cost>(cur[d - cols]);
+        }
+    }
+}
+
+// Maps the ids of both sides to dense 32-bit ids for the vector kernel.
+void DenseIds(const std::vector<size_t> &left, const std::vector<size_t> &right,
+              std::vector<uint32_t> *dense_left,
+              std::vector<uint32_t> *dense_right_reversed) {
+    std::vector<size_t> ids(left);
+    ids.insert(ids.end(), right.begin(), right.end());
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    dense_left->resize(left.size());
+    for (size_t i = 0; i < left.size(); ++i) {
+        (*dense_left)[i] = static_cast<uint32_t>(
+            std::lower_bound(ids.begin(), ids.end(), left[i]) - ids.begin());
+    }
+    dense_right_reversed->resize(right.size());
+    for (size_t i = 0; i < right.size(); ++i) {
+        (*dense_right_reversed)[right.size() - 1 - i] =
+            static_cast<uint32_t>(
+                std::lower_bound(ids.begin(), ids.end(), right[i]) -
+                ids.begin());
+    }
+}
+
+// Whether every cost of the DP fits the 32-bit lanes.
+bool FitsLanes32(size_t left_size, size_t right_size, Cost unit) {
+    return (left_size + right_size) * (unit + 1) <=
+           static_cast<Cost>(INT32_MAX);
+}
+
+template <typename Script>
+void CalculateAvx2Edits(const std::vector<size_t> &left,
+                        const std::vector<size_t> &right, Script *script) {
+    const Cost unit = CostUnit(left.size(), right.size());
+    std::vector<uint32_t> dense_left, dense_right_reversed;
+    DenseIds(left, right, &dense_left, &dense_right_reversed);
+
+    std::vector<Cost> top(right.size() + 1), side(left.size() + 1);
+    for (size_t r_i = 0; r_i < top.size(); ++r_i) top[r_i] = r_i * unit;
+    for (size_t l_i = 0; l_i < side.size(); ++l_i) side[l_i] = l_i * unit;
+
+    DiagonalMoves best_move(left.size(), right.size());
+    if (FitsLanes32(left.size(), right.size(), unit)) {
+        FillDiagonalMoves<Avx2Lanes32>(
+            dense_left.data(), left.size(), dense_right_reversed.data(),
+            right.size(), top.data(), side.data(), unit, &best_move, NULL,
+            NULL);
+    } else {
+        FillDiagonalMoves<Avx2Lanes64>(
+            dense_left.data(), left.size(), dense_right_reversed.data(),
+            right.size(), top.data(), side.data(), unit, &best_move, NULL,
+            NULL);
+    }
+
+    script->clear();
+    ReserveScript(left.size() + right.size(), script);
+    AppendTraceback(best_move, left.size(), right.size(), script);
+    std::reverse(script->begin(), script->end());
+}
+
+bool CpuHasAvx2() {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+
+// Below this many DP cells the vector kernel does not pay for its setup.
+const size_t kVectorMinCells = 1 << 12;
+#endif  // EDIT_DISTANCE_USE_AVX2
+
+// Stores in 'edits' the Wagner-Fischer script, with the scalar DP in
+// 'buffers' below kVectorMinCells.
+template <typename Script>
+void CalculateWagnerFischerEdits(const std::vector<size_t> &left,
+                                 const std::vector<size_t> &right,
+                                 Workspace::Buffers *buffers, Script *edits) {
+#if EDIT_DISTANCE_USE_AVX2
+    if (left.size() * right.size() >= kVectorMinCells && CpuHasAvx2()) {
+        CalculateAvx2Edits(left, right, edits);
+        return;
+    }
+#endif
+    const Cost unit = CostUnit(left.size(), right.size());
+    // Populate for empty right and empty left.
+    std::vector<Cost> &boundary = buffers->boundary;
+    boundary.resize(right.size() + left.size() + 2);
+    Cost *top = boundary.data(), *side = top + right.size() + 1;
+    for (size_t r_i = 0; r_i <= right.size(); ++r_i) top[r_i] = r_i * unit;
+    for (size_t l_i = 0; l_i <= left.size(); ++l_i) side[l_i] = l_i * unit;
+
+    PackedMoves best_move(left.size(), right.size(), &buffers->moves);
+    FillMoves(left.data(), left.size(), right.data(), right.size(), top, side,
+              unit, &best_move, &buffers->costs);
+
+    // Reconstruct the best path. We do it in reverse order.
+    edits->clear();
+    ReserveScript(left.size() + right.size(), edits);
+    AppendTraceback(best_move, left.size(), right.size(), edits);
+    std::reverse(edits->begin(), edits->end());
+}
+
+// Same as above with the calling thread's Workspace, for the entry points
+// that take no DiffOptions.
+std::vector<EditType> CalculateWagnerFischerEdits(
+    const std::vector<size_t> &left, const std::vector<size_t> &right) {
+    std::vector<EditType> edits;
+    CalculateWagnerFischerEdits(left, right, GetBuffers(NULL), &edits);
+    return edits;
+}
+
+// The parallel DP works on tiles of kTileSize x kTileSize cells. The size is
+// a multiple of 32 so that two tiles never share a traceback word.
+const size_t kTileSize = 512;
+
+// Blocks the calling threads until 'count' of them are waiting.
+class Barrier {
+   public:
+    explicit Barrier(size_t count) : count_(count), waiting_(0), phase_(0) {}
+
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const size_t phase = phase_;
+        if (++waiting_ == count_) {
+            waiting_ = 0;
+            ++phase_;
+            condition_.notify_all();
+            return;
+        }
+        while (phase == phase_) condition_.wait(lock);
+    }
+
+   private:
+    size_t count_, waiting_, phase_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+};
+
+// Below this many DP cells kParallel runs the serial DP: the threads would
+// cost more than they save.
+const size_t kParallelMinCells = 1 << 20;
+
+// State shared by the threads of CalculateParallelEdits. The DP borders of
+// the tiles live in 'bottom' and 'right_edge': bottom[r_i] is the cost of
+// column r_i on the last row of the latest finished tile above, right_edge[l_i]
+// the cost of row l_i on the last column of the latest finished tile to the
+// left. corners[] holds the top-left cost of each tile, which both arrays
+// have overwritten by the time the tile runs.
+// When the CPU has AVX2, each tile runs the vector kernel and keeps its own
+// DiagonalMoves; otherwise the scalar rows go to one PackedMoves.
+class WavefrontDp {
+   public:
+    WavefrontDp(const std::vector<size_t> &left,
+                const std::vector<size_t> &right)
+        : left_(left),
+          right_(right),
+          unit_(CostUnit(left.size(), right.size())),
+          tile_rows_((left.size() + kTileSize - 1) / kTileSize),
+          tile_cols_((right.size() + kTileSize - 1) / kTileSize),
+#if EDIT_DISTANCE_USE_AVX2
+          vector_(CpuHasAvx2()),
+#else
+          vector_(false),
+#endif
+          bottom_(right.size() + 1),
+          right_edge_(left.size() + 1),
+          corners_((tile_rows_ + 1) * (tile_cols_ + 1)),
+          moves_(vector_ ? 0 : left.size(), right.size()) {
+        // Populate for empty right and empty left.
+        for (size_t r_i = 0; r_i < bottom_.size(); ++r_i) {
+            bottom_[r_i] = r_i * unit_;
+        }
+        for (size_t l_i = 0; l_i < right_edge_.size(); ++l_i) {
+            right_edge_[l_i] = l_i * unit_;
+        }
+        for (size_t t_i = 0; t_i <= tile_rows_; ++t_i) {
+            corners_[t_i * (tile_cols_ + 1)] = t_i * kTileSize * unit_;
+        }
+        for (size_t t_j = 0; t_j <= tile_cols_; ++t_j) {
+            corners_[t_j] = t_j * kTileSize * unit_;
+        }
+#if EDIT_DISTANCE_USE_AVX2
+        if (vector_) {
+            DenseIds(left, right, &dense_left_, &dense_right_reversed_);
+            lanes32_ = FitsLanes32(left.size(), right.size(), unit_);
+            tiles_.reserve(tile_rows_ * tile_cols_);
+            for (size_t t_i = 0; t_i < tile_rows_; ++t_i) {
+                for (size_t t_j = 0; t_j < tile_cols_; ++t_j) {
+                    tiles_.push_back(DiagonalMoves(
+                        std::min(kTileSize, left.size() - t_i * kTileSize),
+                        std::min(kTileSize, right.size() - t_j * kTileSize)));
+                }
+            }
+        }
+#endif
+    }
+
+    // The most tiles that can run at once, those of the longest
+    // anti-diagonal.
+    size_t max_threads() const { return std::min(tile_rows_, tile_cols_); }
+
+    // Runs the tiles of every anti-diagonal that fall to 'thread' out of
+    // 'threads', waiting on 'barrier' between anti-diagonals.
+    void Run(size_t thread, size_t threads, Barrier *barrier) {
+        for (size_t diagonal = 0; diagonal + 1 < tile_rows_ + tile_cols_;
+             ++diagonal) {
+            const size_t first =
+                diagonal >= tile_cols_ ? diagonal - tile_cols_ + 1 : 0;
+            const size_t last = std::min(diagonal, tile_rows_ - 1);
+            for (size_t t_i = first + thread; t_i <= last; t_i += threads) {
+                FillTile(t_i, diagonal - t_i);
+            }
+            if (threads > 1) barrier->Wait();
+        }
+    }
+
+    // Returns the move of DP cell (l_i, r_i), for AppendTraceback.
+    EditType Get(size_t l_i, size_t r_i) const {
+#if EDIT_DISTANCE_USE_AVX2
+        if (vector_ && l_i > 0 && r_i > 0) {
+            const size_t t_i = (l_i - 1) / kTileSize;
+            const size_t t_j = (r_i - 1) / kTileSize;
+            return tiles_[t_i * tile_cols_ + t_j].Get(l_i - t_i * kTileSize,
+                                                      r_i - t_j * kTileSize);
+        }
+#endif
+        return moves_.Get(l_i, r_i);
+    }
+
+   private:
+    void FillTile(size_t t_i, size_t t_j) {
+        const size_t l_begin = t_i * kTileSize, r_begin = t_j * kTileSize;
+        const size_t rows = std::min(kTileSize, left_.size() - l_begin);
+        const size_t cols = std::min(kTileSize, right_.size() - r_begin);
+        const Cost corner = corners_[t_i * (tile_cols_ + 1) + t_j];
+#if EDIT_DISTANCE_USE_AVX2
+        if (vector_) {
+            FillVectorTile(t_i, t_j, rows, cols, corner);
+            return;
+        }
+#endif
+        std::vector<Cost> prev(cols + 1), row(cols + 1);
+        prev[0] = corner;
+        std::copy(&bottom_[r_begin + 1], &bottom_[r_begin + cols + 1],
+                  &prev[1]);
+        for (size_t l_i = l_begin; l_i < l_begin + rows; ++l_i) {
+            row[0] = right_edge_[l_i + 1];
+            FillRow(left_[l_i], &right_[r_begin], cols, prev.data(),
+                    row.data(), unit_,
+                    moves_.row(l_i) + r_begin / PackedMoves::kCellsPerWord);
+            right_edge_[l_i + 1] = row[cols];
+            prev.swap(row);
+        }
+        std::copy(&prev[1], &prev[cols + 1], &bottom_[r_begin + 1]);
+        corners_[(t_i + 1) * (tile_cols_ + 1) + t_j + 1] = prev[cols];
+    }
+
+#if EDIT_DISTANCE_USE_AVX2
+    void FillVectorTile(size_t t_i, size_t t_j, size_t rows, size_t cols,
+                        Cost corner) {
+        const size_t l_begin = t_i * kTileSize, r_begin = t_j * kTileSize;
+        std::vector<Cost> top(cols + 1), side(rows + 1), bottom(cols + 1),
+            right_edge(rows + 1);
+        top[0] = side[0] = corner;
+        std::copy(&bottom_[r_begin + 1], &bottom_[r_begin + cols + 1],
+                  &top[1]);
+        std::copy(&right_edge_[l_begin + 1], &right_edge_[l_begin + rows + 1],
+                  &side[1]);
+        // The tile's right ids, back to front, end where the next tile's
+        // begin in dense_right_reversed_.
+        const uint32_t *right_reversed = dense_right_reversed_.data() +
+                                         right_.size() - r_begin - cols;
+        DiagonalMoves *moves = &tiles_[t_i * tile_cols_ + t_j];
+        if (lanes32_) {
+            FillDiagonalMoves<Avx2Lanes32>(
+                dense_left_.data() + l_begin, rows, right_reversed, cols,
+                top.data(), side.data(), unit_, moves, bottom.data(),
+                right_edge.data());
+        } else {
+            FillDiagonalMoves<Avx2Lanes64>(
+                dense_left_.data() + l_begin, rows, right_reversed, cols,
+                top.data(), side.data(), unit_, moves, bottom.data(),
+                right_edge.data());
+        }
+        std::copy(&bottom[1], &bottom[cols + 1], &bottom_[r_begin + 1]);
+        std::copy(&right_edge[1], &right_edge[rows + 1],
+                  &right_edge_[l_begin + 1]);
+        corners_[(t_i + 1) * (tile_cols_ + 1) + t_j + 1] = bottom[cols];
+    }
+#endif
+
+    const std::vector<size_t> &left_, &right_;
+    const Cost unit_;
+    const size_t tile_rows_, tile_cols_;
+    const bool vector_;
+    std::vector<Cost> bottom_, right_edge_, corners_;
+    PackedMoves moves_;
+#if EDIT_DISTANCE_USE_AVX2
+    std::vector<uint32_t> dense_left_, dense_right_reversed_;
+    bool lanes32_;
+    std::vector<DiagonalMoves> tiles_;
+#endif
+};
+
+// Stores in 'edits' the script of the wavefront DP on 'threads' threads,
+// with the serial DP in 'buffers' below kParallelMinCells.
+template <typename Script>
+void CalculateParallelEdits(const std::vector<size_t> &left,
+                            const std::vector<size_t> &right, size_t threads,
+                            Workspace::Buffers *buffers, Script *edits) {
+    if (left.size() * right.size() < kParallelMinCells) {
+        CalculateWagnerFischerEdits(left, right, buffers, edits);
+        return;
+    }
+    WavefrontDp dp(left, right);
+    threads = std::max<size_t>(std::min(threads, dp.max_threads()), 1);
+    Barrier barrier(threads);
+    std::vector<std::thread> workers;
+    for (size_t thread = 1; thread < threads; ++thread) {
+        workers.push_back(std::thread(&WavefrontDp::Run, &dp, thread, threads,
+                                      &barrier));
+    }
+    dp.Run(0, threads, &barrier);
+    for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+
+    edits->clear();
+    ReserveScript(left.size() + right.size(), edits);
+    AppendTraceback(dp, left.size(), right.size(), edits);
+    std::reverse(edits->begin(), edits->end());
+}
+
+std::vector<EditType> CalculateParallelEdits(const std::vector<size_t> &left,
+                                             const std::vector<size_t> &right,
+                                             size_t threads) {
+    std::vector<EditType> edits;
+    CalculateParallelEdits(left, right, threads, GetBuffers(NULL), &edits);
+    return edits;
+}
+
+// Below this many DP cells a region is solved with a full matrix.
+const size_t kLinearSpaceBaseCells = 1 << 16;
+
+// Solves the region [row_begin, row_end] x [col_begin, col_end] of the
+// Wagner-Fischer DP, given its first row (top[j] = costs[row_begin][col_begin
+// + j]) and first column (side[i] = costs[row_begin + i][col_begin]).
+// Appends to 'reversed_path' the reference traceback from (row_end, col_end)
+// back to (row_begin, col_begin), which the caller guarantees goes through
+// both corners.
+//
+// The region is split at its middle row. The forward sweep below the middle
+// row also propagates, for every cell, the column at which its traceback
+// enters the middle row. That column splits the path into an upper-left and a
+// lower-right region which are solved recursively. Since the cells are
+// computed with the same ChooseMove calls as the full matrix, the path is the
+// reference one. Costs about 3x the full DP time.
+template <typename Script>
+void AppendLinearSpaceEdits(const size_t *left, const size_t *right,
+                            size_t row_begin, size_t row_end,
+                            size_t col_begin, size_t col_end,
+                            const Cost *top, const Cost *side, Cost unit,
+                            Script *reversed_path) {
+    const size_t rows = row_end - row_begin, cols = col_end - col_begin;
+    if (rows == 0 || cols == 0) {
+        // The path runs along the region border.
+        AppendRun(kAdd, cols, reversed_path);
+        AppendRun(kRemove, rows, reversed_path);
+        return;
+    }
+
+    if (rows == 1 || (rows + 1) * (cols + 1) <= kLinearSpaceBaseCells) {
+        PackedMoves best_move(rows, cols);
+        std::vector<Cost> costs;
+        FillMoves(left + row_begin, rows, right + col_begin, cols, top, side,
+                  unit, &best_move, &costs);
+        AppendTraceback(best_move, rows, cols, reversed_path);
+        return;
+    }
+
+    const size_t mid = rows / 2;
+    std::vector<Cost> prev(top, top + cols + 1), row(cols + 1);
+    for (size_t i = 1; i <= mid; ++i) {
+        row[0] = side[i];
+        for (size_t j = 1; j <= cols; ++j) {
+            ChooseMove(left[row_begin + i - 1] == right[col_begin + j - 1],
+                       row[j - 1], prev[j], prev[j - 1], unit, &row[j]);
+        }
+        prev.swap(row);
+    }
+    const std::vector<Cost> mid_row(prev);
+
+    // cross[j] is the column at which the traceback from the current cell
+    // enters the middle row.
+    std::vector<size_t> prev_cross(cols + 1), cross(cols + 1, 0);
+    for (size_t j = 0; j <= cols; ++j) prev_cross[j] = j;
+    for (size_t i = mid + 1; i <= rows; ++i) {
+        row[0] = side[i];
+        for (size_t j = 1; j <= cols; ++j) {
+            const EditType move = ChooseMove(
+                left[row_begin + i - 1] == right[col_begin + j - 1],
+                row[j - 1], prev[j], prev[j - 1], unit, &row[j]);
+            cross[j] = move == kAdd      ? cross[j - 1]
+                       : move == kRemove ? prev_cross[j]
+                                         : prev_cross[j - 1];
+        }
+        prev.swap(row);
+        prev_cross.swap(cross);
+    }
+    const size_t split = prev_cross[cols];
+
+    {
+        // Sweep the rows below the middle again to recover the first column
+        // of the lower-right region.
+        std::vector<Cost> split_side(rows - mid + 1);
+        split_side[0] = mid_row[split];
+        prev.assign(mid_row.begin(), mid_row.begin() + split + 1);
+        row.resize(split + 1);
+        for (size_t i = mid + 1; i <= rows; ++i) {
+            row[0] = side[i];
+            for (size_t j = 1; j <= split; ++j) {
+                ChooseMove(left[row_begin + i - 1] == right[col_begin + j - 1],
+                           row[j - 1], prev[j], prev[j - 1], unit, &row[j]);
+            }
+            split_side[i - mid] = row[split];
+            prev.swap(row);
+        }
+        std::vector<Cost>().swap(prev);
+        std::vector<Cost>().swap(row);
+        std::vector<size_t>().swap(prev_cross);
+        std::vector<size_t>().swap(cross);
+
+        AppendLinearSpaceEdits(left, right, row_begin + mid, row_end,
+                               col_begin + split, col_end, &mid_row[split],
+                               split_side.data(), unit, reversed_path);
+    }
+    AppendLinearSpaceEdits(left, right, row_begin, row_begin + mid, col_begin,
+                           col_begin + split, top, side, unit,
+                           reversed_path);
+}
+
+// Stores in 'edits' the script of the linear space DP.
+template <typename Script>
+void CalculateLinearSpaceEdits(const std::vector<size_t> &left,
+                               const std::vector<size_t> &right,
+                               Script *edits) {
+    const Cost unit = CostUnit(left.size(), right.size());
+    std::vector<Cost> top(right.size() + 1), side(left.size() + 1);
+    for (size_t r_i = 0; r_i < top.size(); ++r_i) top[r_i] = r_i * unit;
+    for (size_t l_i = 0; l_i < side.size(); ++l_i) side[l_i] = l_i * unit;
+    edits->clear();
+    ReserveScript(left.size() + right.size(), edits);
+    AppendLinearSpaceEdits(left.data(), right.data(), 0, left.size(), 0,
+                           right.size(), top.data(), side.data(), unit, edits);
+    std::reverse(edits->begin(), edits->end());
+}
+
+// Finds the 'middle snake' of the shortest add/remove path from (0, 0) to
+// (n, m) by running the greedy search forward from the start and backward from
+// the end until the two fronts overlap. On success stores in (*x, *y) a point
+// the shortest path goes through, strictly inside the rectangle.
+// Returns false if the sequences have nothing in common.
+bool FindMiddleSnake(const size_t *left, size_t n, const size_t *right,
+                     size_t m, size_t *x, size_t *y) {
+    typedef std::ptrdiff_t Index;
+    const Index max_d = static_cast<Index>((n + m + 1) / 2);
+    const Index v_offset = max_d;
+    const Index v_length = 2 * max_d + 2;
+    // v_forward[k] is the furthest x reached on diagonal k = x - y from the
+    // start, v_backward[k] the same measured from the end. -1 is unvisited.
+    std::vector<Index> v_forward(v_length, -1), v_backward(v_length, -1);
+    v_forward[v_offset + 1] = 0;
+    v_backward[v_offset + 1] = 0;
+
+    const Index in = static_cast<Index>(n), im = static_cast<Index>(m);
+    const Index delta = in - im;
+    // If the total number of elements is odd, then the front path will
+    // collide with the reverse path.
+    const bool front = (delta % 2 != 0);
+    // Offsets for start and end of k loop. Prevents mapping of space beyond
+    // the grid.
+    Index k1_start = 0, k1_end = 0, k2_start = 0, k2_end = 0;
+    for (Index d = 0; d < max_d; ++d) {
+        // Walk the front path one step.
+        for (Index k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2) {
+            const Index k1_offset = v_offset + k1;
+            Index x1;
+            if (k1 == -d || (k1 != d && v_forward[k1_offset - 1] <
+                                            v_forward[k1_offset + 1])) {
+                x1 = v_forward[k1_offset + 1];
+            } else {
+                x1 = v_forward[k1_offset - 1] + 1;
+            }
+            Index y1 = x1 - k1;
+            while (x1 < in && y1 < im && left[x1] == right[y1]) {
+                ++x1;
+                ++y1;
+            }
+            v_forward[k1_offset] = x1;
+            if (x1 > in) {
+                // Ran off the right of the graph.
+                k1_end += 2;
+            } else if (y1 > im) {
+                // Ran off the bottom of the graph.
+                k1_start += 2;
+            } else if (front) {
+                const Index k2_offset = v_offset + delta - k1;
+                if (k2_offset >= 0 && k2_offset < v_length &&
+                    v_backward[k2_offset] != -1 &&
+                    x1 >= in - v_backward[k2_offset]) {
+                    // Overlap detected.
+                    *x = static_cast<size_t>(x1);
+                    *y = static_cast<size_t>(y1);
+                    return true;
+                }
+            }
+        }
+
+        // Walk the reverse path one step.
+        for (Index k2 = -d + k2_start; k2 <= d - k2_end; k2 += 2) {
+            const Index k2_offset = v_offset + k2;
+            Index x2;
+            if (k2 == -d || (k2 != d && v_backward[k2_offset - 1] <
+                                            v_backward[k2_offset + 1])) {
+                x2 = v_backward[k2_offset + 1];
+            } else {
+                x2 = v_backward[k2_offset - 1] + 1;
+            }
+            Index y2 = x2 - k2;
+            while (x2 < in && y2 < im &&
+                   left[in - x2 - 1] == right[im - y2 - 1]) {
+                ++x2;
+                ++y2;
+            }
+            v_backward[k2_offset] = x2;
+            if (x2 > in) {
+                k2_end += 2;
+            } else if (y2 > im) {
+                k2_start += 2;
+            } else if (!front) {
+                const Index k1_offset = v_offset + delta - k2;
+                if (k1_offset >= 0 && k1_offset < v_length &&
+                    v_forward[k1_offset] != -1) {
+                    const Index x1 = v_forward[k1_offset];
+                    const Index y1 = v_offset + x1 - k1_offset;
+                    if (x1 >= in - x2) {
+                        *x = static_cast<size_t>(x1);
+                        *y = static_cast<size_t>(y1);
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Appends to 'edits' a shortest add/remove script from left[0, n) to
+// right[0, m).
+template <typename Script>
+void AppendMyersEdits(const size_t *left, size_t n, const size_t *right,
+                      size_t m, Script *edits) {
+    // Strip the common prefix and suffix; they are always part of a shortest
+    // path and this keeps FindMiddleSnake away from the trivial cases.
+    size_t prefix = 0;
+    while (prefix < n && prefix < m && left[prefix] == right[prefix]) {
+        ++prefix;
+    }
+    AppendRun(kMatch, prefix, edits);
+    left += prefix;
+    right += prefix;
+    n -= prefix;
+    m -= prefix;
+    size_t suffix = 0;
+    while (suffix < n && suffix < m &&
+           left[n - suffix - 1] == right[m - suffix - 1]) {
+        ++suffix;
+    }
+    n -= suffix;
+    m -= suffix;
+
+    size_t x, y;
+    if (n == 0 || m == 0 || !FindMiddleSnake(left, n, right, m, &x, &y)) {
+        AppendRun(kRemove, n, edits);
+        AppendRun(kAdd, m, edits);
+    } else {
+        AppendMyersEdits(left, x, right, y, edits);
+        AppendMyersEdits(left + x, n - x, right + y, m - y, edits);
+    }
+    AppendRun(kMatch, suffix, edits);
+}
+
+std::vector<EditType> CalculateMyersEdits(const std::vector<size_t> &left,
+                                          const std::vector<size_t> &right) {
+    std::vector<EditType> edits;
+    edits.reserve(std::max(left.size(), right.size()));
+    AppendMyersEdits(left.data(), left.size(), right.data(), right.size(),
+                     &edits);
+    return edits;
+}
+
+// Number of occurrences of the id of each element on both sides. Groups
+// and counts are 32-bit, as the interned lines are: at most 2^32 - 1
+// elements.
+class IdCounts {
+   public:
+    IdCounts(const size_t *left, size_t n, const size_t *right, size_t m)
+        : left_group_(n), right_group_(m) {
+        size_t max_id = 0;
+        for (size_t i = 0; i < n; ++i) max_id = std::max(max_id, left[i]);
+        for (size_t i = 0; i < m; ++i) max_id = std::max(max_id, right[i]);
+        if (max_id < 2 * (n + m)) {
+            CountDenseIds(left, n, right, m, max_id);
+        } else {
+            CountSortedIds(left, n, right, m);
+        }
+    }
+
+    // Occurrences on the left/right side of the id of left[i]/right[i].
+    size_t left_of_left(size_t i) const {
+        return counts_[left_group_[i]].first;
+    }
+    size_t right_of_left(size_t i) const {
+        return counts_[left_group_[i]].second;
+    }
+    size_t left_of_right(size_t i) const {
+        return counts_[right_group_[i]].first;
+    }
+    size_t right_of_right(size_t i) const {
+        return counts_[right_group_[i]].second;
+    }
+    // Dense id of left[i]/right[i].
+    size_t left_group(size_t i) const { return left_group_[i]; }
+    size_t right_group(size_t i) const { return right_group_[i]; }
+    size_t groups() const { return counts_.size(); }
+
+   private:
+    // Ids from interned lines are already dense: one group per id, possibly
+    // empty, counted in place.
+    void CountDenseIds(const size_t *left, size_t n, const size_t *right,
+                       size_t m, size_t max_id) {
+        counts_.resize(max_id + 1);
+        for (size_t i = 0; i < n; ++i) {
+            left_group_[i] = left[i];
+            ++counts_[left[i]].first;
+        }
+        for (size_t i = 0; i < m; ++i) {
+            right_group_[i] = right[i];
+            ++counts_[right[i]].second;
+        }
+    }
+
+    // Other ids are grouped by sorting the (id, position) pairs once; right
+    // positions are offset by n. Each run of equal ids becomes a group.
+    void CountSortedIds(const size_t *left, size_t n, const size_t *right,
+                        size_t m) {
+        std::vector<std::pair<size_t, size_t> > elements(n + m);
+        for (size_t i = 0; i < n; ++i) elements[i] = std::make_pair(left[i], i);
+        for (size_t i = 0; i < m; ++i) {
+            elements[n + i] = std::make_pair(right[i], n + i);
+        }
+        std::sort(elements.begin(), elements.end());
+        for (size_t i = 0; i < elements.size(); ++i) {
+            if (i == 0 || elements[i].first != elements[i - 1].first) {
+                counts_.push_back(std::make_pair(0u, 0u));
+            }
+            const size_t position = elements[i].second;
+            if (position < n) {
+                left_group_[position] = counts_.size() - 1;
+                ++counts_.back().first;
+            } else {
+                right_group_[position - n] = counts_.size() - 1;
+                ++counts_.back().second;
+            }
+        }
+    }
+
+    std::vector<uint32_t> left_group_, right_group_;
+    std::vector<std::pair<uint32_t, uint32_t> > counts_;
+};
+
+// Keeps in 'pairs', sorted by left position, the longest subsequence whose
+// right positions increase too (patience sorting). Each pair is a (left,
+// right) position of the same element.
+template <typename Index>
+void KeepIncreasingPairs(std::vector<std::pair<Index, Index> > *pairs) {
+    // tails[k] is the index of the pair ending the best chain of length k+1.
+    std::vector<Index> tails, back(pairs->size());
+    for (size_t i = 0; i < pairs->size(); ++i) {
+        size_t lo = 0, hi = tails.size();
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            if ((*pairs)[tails[mid]].second < (*pairs)[i].second) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        back[i] = lo > 0 ? tails[lo - 1] : i;
+        if (lo == tails.size()) {
+            tails.push_back(i);
+        } else {
+            tails[lo] = i;
+        }
+    }
+    std::vector<std::pair<Index, Index> > chain(tails.size());
+    for (size_t k = tails.size(), i = tails.empty() ? 0 : tails.back(); k > 0;
+         --k, i = back[i]) {
+        chain[k - 1] = (*pairs)[i];
+    }
+    pairs->swap(chain);
+}
+
+// Appends the matches of the common prefix of left[0, n) and right[0, m)
+// and strips it, and strips the common suffix, returned in 'suffix'.
+template <typename Script>
+void StripCommonEnds(const size_t **left, size_t *n, const size_t **right,
+                     size_t *m, size_t *suffix, Script *edits) {
+    size_t prefix = 0;
+    while (prefix < *n && prefix < *m && (*left)[prefix] == (*right)[prefix]) {
+        ++prefix;
+    }
+    AppendRun(kMatch, prefix, edits);
+    *left += prefix;
+    *right += prefix;
+    *n -= prefix;
+    *m -= prefix;
+    *suffix = 0;
+    while (*suffix < *n && *suffix < *m &&
+           (*left)[*n - *suffix - 1] == (*right)[*m - *suffix - 1]) {
+        ++*suffix;
+    }
+    *n -= *suffix;
+    *m -= *suffix;
+}
+
+// Patience diff: matches the elements that occur once on each side, in
+// the longest run of increasing positions, and recurses between them.
+// Falls back to Myers where there is no such element.
+template <typename Script>
+void AppendPatienceEdits(const size_t *left, size_t n, const size_t *right,
+                         size_t m, Script *edits) {
+    size_t suffix;
+    StripCommonEnds(&left, &n, &right, &m, &suffix, edits);
+    if (n == 0 || m == 0) {
+        AppendRun(kRemove, n, edits);
+        AppendRun(kAdd, m, edits);
+    } else {
+        const IdCounts counts(left, n, right, m);
+        std::vector<uint32_t> unique_right(counts.groups());
+        for (size_t i = 0; i < m; ++i) {
+            if (counts.left_of_right(i) == 1 && counts.right_of_right(i) == 1) {
+                unique_right[counts.right_group(i)] = i;
+            }
+        }
+        std::vector<std::pair<size_t, size_t> > anchors;
+        for (size_t i = 0; i < n; ++i) {
+            if (counts.left_of_left(i) == 1 && counts.right_of_left(i) == 1) {
+                anchors.push_back(
+                    std::make_pair(i, unique_right[counts.left_group(i)]));
+            }
+        }
+        if (anchors.empty()) {
+            AppendMyersEdits(left, n, right, m, edits);
+        } else {
+            KeepIncreasingPairs(&anchors);
+            size_t l_i = 0, r_i = 0;
+            for (size_t k = 0; k < anchors.size(); ++k) {
+                AppendPatienceEdits(left + l_i, anchors[k].first - l_i,
+                                    right + r_i, anchors[k].second - r_i,
+                                    edits);
+                AppendEdit(kMatch, edits);
+                l_i = anchors[k].first + 1;
+                r_i = anchors[k].second + 1;
+            }
+            AppendPatienceEdits(left + l_i, n - l_i, right + r_i, m - r_i,
+                                edits);
+        }
+    }
+    AppendRun(kMatch, suffix, edits);
+}
+
+// Elements occurring more often than this on the left side are not used to
+// split the input by the histogram diff. Same limit as git.
+const size_t kHistogramMaxOccurrences = 64;
+
+// Histogram diff: matches the longest common run around the elements that
+// occur the least often on the left side, and recurses before and after
+// it. Falls back to Myers when all the common elements are too frequent.
+template <typename Script>
+void AppendHistogramEdits(const size_t *left, size_t n, const size_t *right,
+                          size_t m, Script *edits) {
+    size_t suffix;
+    StripCommonEnds(&left, &n, &right, &m, &suffix, edits);
+    // Loop on the part after the matched run rather than recursing, so
+    // that the depth only grows with the parts before it.
+    while (n > 0 && m > 0) {
+        const IdCounts counts(left, n, right, m);
+        // Left positions of each group, in increasing order.
+        std::vector<size_t> starts(counts.groups() + 1), positions(n);
+        for (size_t i = 0; i < n; ++i) ++starts[counts.left_group(i) + 1];
+        for (size_t g = 0; g < counts.groups(); ++g) {
+            starts[g + 1] += starts[g];
+        }
+        std::vector<size_t> next(starts.begin(), starts.end() - 1);
+        for (size_t i = 0; i < n; ++i) {
+            positions[next[counts.left_group(i)]++] = i;
+        }
+
+        bool common = false;
+        size_t best_count = kHistogramMaxOccurrences + 1;
+        size_t best_left = 0, best_right = 0, best_size = 0;
+        for (size_t r_i = 0, next_r_i; r_i < m; r_i = next_r_i) {
+            next_r_i = r_i + 1;
+            const size_t occurrences = counts.left_of_right(r_i);
+            common = common || occurrences > 0;
+            if (occurrences == 0 || occurrences > best_count) continue;
+            const size_t group = counts.right_group(r_i);
+            for (size_t k = starts[group]; k < starts[group + 1]; ++k) {
+                size_t l_begin = positions[k], r_begin = r_i;
+                size_t l_end = l_begin + 1, r_end = r_i + 1;
+                size_t region_count = occurrences;
+                while (l_begin > 0 && r_begin > 0 &&
+                       left[l_begin - 1] == right[r_begin - 1]) {
+                    --l_begin;
+                    --r_begin;
+                    region_count =
+                        std::min(region_count, counts.left_of_left(l_begin));
+                }
+                while (l_end < n && r_end < m && left[l_end] == right[r_end]) {
+                    region_count =
+                        std::min(region_count, counts.left_of_left(l_end));
+                    ++l_end;
+                    ++r_end;
+                }
+                next_r_i = std::max(next_r_i, r_end);
+                if (l_end - l_begin > best_size || region_count < best_count) {
+                    best_left = l_begin;
+                    best_right = r_begin;
+                    best_size = l_end - l_begin;
+                    best_count = region_count;
+                }
+            }
+        }
+        if (best_size == 0) {
+            if (common) {
+                AppendMyersEdits(left, n, right, m, edits);
+            } else {
+                AppendRun(kRemove, n, edits);
+                AppendRun(kAdd, m, edits);
+            }
+            n = m = 0;
+            break;
+        }
+        AppendHistogramEdits(left, best_left, right, best_right, edits);
+        AppendRun(kMatch, best_size, edits);
+        left += best_left + best_size;
+        right += best_right + best_size;
+        n -= best_left + best_size;
+        m -= best_right + best_size;
+    }
+    AppendRun(kRemove, n, edits);
+    AppendRun(kAdd, m, edits);
+    AppendRun(kMatch, suffix, edits);
+}
+
+std::vector<EditType> CalculatePatienceEdits(const std::vector<size_t> &left,
+                                             const std::vector<size_t> &right) {
+    std::vector<EditType> edits;
+    edits.reserve(std::max(left.size(), right.size()));
+    AppendPatienceEdits(left.data(), left.size(), right.data(), right.size(),
+                        &edits);
+    return edits;
+}
+
+std::vector<EditType> CalculateHistogramEdits(
+    const std::vector<size_t> &left, const std::vector<size_t> &right) {
+    std::vector<EditType> edits;
+    edits.reserve(std::max(left.size(), right.size()));
+    AppendHistogramEdits(left.data(), left.size(), right.data(), right.size(),
+                         &edits);
+    return edits;
+}
+
+// Appends the script of kSorted for left[0, n) to right[0, m). 'Line' is
+// anything with operator<, ids or lines.
+template <typename Line, typename Script>
+void AppendSortedEdits(const Line *left, size_t n, const Line *right,
+                       size_t m, Script *edits) {
+    size_t l_i = 0, r_i = 0;
+    while (l_i < n && r_i < m) {
+        if (left[l_i] < right[r_i]) {
+            AppendEdit(kRemove, edits);
+            ++l_i;
+        } else if (right[r_i] < left[l_i]) {
+            AppendEdit(kAdd, edits);
+            ++r_i;
+        } else {
+            AppendEdit(kMatch, edits);
+            ++l_i;
+            ++r_i;
+        }
+    }
+    AppendRun(kRemove, n - l_i, edits);
+    AppendRun(kAdd, m - r_i, edits);
+}
+
+// Whether kSorted finds a shortest script for 'left' and 'right', or
+// 'check' is off.
+template <typename Sequence>
+bool SortedOrUnchecked(const Sequence &left, const Sequence &right,
+                       bool check) {
+    return !check || (std::is_sorted(left.begin(), left.end()) &&
+                      std::is_sorted(right.begin(), right.end()));
+}
+
+// The script of kSorted, or of kMyers when 'check' finds a side that is not
+// sorted.
+template <typename Script>
+void CalculateSortedEdits(const std::vector<size_t> &left,
+                          const std::vector<size_t> &right, bool check,
+                          Script *edits) {
+    edits->clear();
+    if (!SortedOrUnchecked(left, right, check)) {
+        ReserveScript(std::max(left.size(), right.size()), edits);
+        AppendMyersEdits(left.data(), left.size(), right.data(), right.size(),
+                         edits);
+        return;
+    }
+    ReserveScript(left.size() + right.size(), edits);
+    AppendSortedEdits(left.data(), left.size(), right.data(), right.size(),
+                      edits);
+}
+
+std::vector<EditType> CalculateOptimalEdits(const std::vector<size_t> &left,
+                                            const std::vector<size_t> &right,
+                                            Algorithm algorithm) {
+    switch (algorithm) {
+        case kMyers:
+            return CalculateMyersEdits(left, right);
+        case kLinearSpace: {
+            std::vector<EditType> edits;
+            CalculateLinearSpaceEdits(left, right, &edits);
+            return edits;
+        }
+        case kParallel:
+            return CalculateParallelEdits(
+                left, right, std::thread::hardware_concurrency());
+        case kPatience:
+            return CalculatePatienceEdits(left, right);
+        case kHistogram:
+            return CalculateHistogramEdits(left, right);
+        case kSorted: {
+            std::vector<EditType> edits;
+            CalculateSortedEdits(left, right, true, &edits);
+            return edits;
+        }
+        case kWagnerFischer:
+            break;
+    }
+    return CalculateWagnerFischerEdits(left, right);
+}
+
+// Stores in 'edits' the script of kLinearSpace, kParallel, kSorted with its
+// check, or otherwise kWagnerFischer, with the serial DP in 'buffers'.
+template <typename Script>
+void CalculateDpEdits(const std::vector<size_t> &left,
+                      const std::vector<size_t> &right, Algorithm algorithm,
+                      Workspace::Buffers *buffers, Script *edits) {
+    switch (algorithm) {
+        case kLinearSpace:
+            CalculateLinearSpaceEdits(left, right, edits);
+            return;
+        case kParallel:
+            CalculateParallelEdits(left, right,
+                                   std::thread::hardware_concurrency(),
+                                   buffers, edits);
+            return;
+        case kSorted:
+            CalculateSortedEdits(left, right, true, edits);
+            return;
+        default:
+            break;
+    }
+    CalculateWagnerFischerEdits(left, right, buffers, edits);
+}
+
+// Appends the script of 'algorithm' for left[0, n) to right[0, m), with the
+// Wagner-Fischer DP in 'buffers'.
+template <typename Script>
+void AppendEdits(const size_t *left, size_t n, const size_t *right, size_t m,
+                 Algorithm algorithm, Workspace::Buffers *buffers,
+                 Script *edits) {
+    if (n == 0 || m == 0) {
+        AppendRun(kRemove, n, edits);
+        AppendRun(kAdd, m, edits);
+        return;
+    }
+    switch (algorithm) {
+        case kMyers:
+            AppendMyersEdits(left, n, right, m, edits);
+            return;
+        case kPatience:
+            AppendPatienceEdits(left, n, right, m, edits);
+            return;
+        case kHistogram:
+            AppendHistogramEdits(left, n, right, m, edits);
+            return;
+        default:
+            break;
+    }
+    // The DP scripts are built whole, in the same kind of script.
+    const std::vector<size_t> left_gap(left, left + n);
+    const std::vector<size_t> right_gap(right, right + m);
+    Script gap;
+    CalculateDpEdits(left_gap, right_gap, algorithm, buffers, &gap);
+    AppendScript(gap, edits);
+}
+
+// Runs 'algorithm' on left/right reduced as described for
+// DiffOptions::reduce: without the common prefix and suffix, without the
+// elements the other side does not have, and split at the elements that
+// occur exactly once on both sides and in the same order (the anchors).
+// The dropped elements are spliced back into the script.
+// Works on the ids in buffers->left_ids and right_ids, which it compacts in
+// place.
+template <typename Script>
+void CalculateReducedEdits(Algorithm algorithm, Workspace::Buffers *buffers,
+                           Script *edits) {
+    std::vector<size_t> &left = buffers->left_ids;
+    std::vector<size_t> &right = buffers->right_ids;
+    size_t prefix = 0;
+    while (prefix < left.size() && prefix < right.size() &&
+           left[prefix] == right[prefix]) {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < left.size() - prefix && suffix < right.size() - prefix &&
+           left[left.size() - suffix - 1] == right[right.size() - suffix - 1]) {
+        ++suffix;
+    }
+    const size_t n = left.size() - prefix - suffix;
+    const size_t m = right.size() - prefix - suffix;
+
+    // An element the other side lacks can only be removed or added. The
+    // kept ones are moved to the front of 'left' and 'right'.
+    std::vector<bool> left_shared(n), right_shared(m);
+    size_t kept_n = 0, kept_m = 0;
+    // 32-bit like the IdCounts groups.
+    std::vector<std::pair<uint32_t, uint32_t> > anchors;
+    {
+        const IdCounts counts(left.data() + prefix, n, right.data() + prefix,
+                              m);
+        // Kept right position of the elements that occur once on each
+        // side, by dense id.
+        std::vector<uint32_t> unique_right(counts.groups());
+        for (size_t i = 0; i < m; ++i) {
+            right_shared[i] = counts.left_of_right(i) > 0;
+            if (!right_shared[i]) continue;
+            if (counts.left_of_right(i) == 1 &&
+                counts.right_of_right(i) == 1) {
+                unique_right[counts.right_group(i)] =
+                    static_cast<uint32_t>(kept_m);
+            }
+            right[kept_m++] = right[prefix + i];
+        }
+        for (size_t i = 0; i < n; ++i) {
+            left_shared[i] = counts.right_of_left(i) > 0;
+            if (!left_shared[i]) continue;
+            if (counts.left_of_left(i) == 1 && counts.right_of_left(i) == 1) {
+                anchors.push_back(
+                    std::make_pair(static_cast<uint32_t>(kept_n),
+                                   unique_right[counts.left_group(i)]));
+            }
+            left[kept_n++] = left[prefix + i];
+        }
+    }
+    KeepIncreasingPairs(&anchors);
+
+    std::vector<EditRun> kept_runs;
+    size_t kept_l = 0, kept_r = 0;
+    for (size_t k = 0; k <= anchors.size(); ++k) {
+        const size_t l_end = k < anchors.size() ? anchors[k].first : kept_n;
+        const size_t r_end = k < anchors.size() ? anchors[k].second : kept_m;
+        AppendEdits(left.data() + kept_l, l_end - kept_l,
+                    right.data() + kept_r, r_end - kept_r, algorithm, buffers,
+                    &kept_runs);
+        if (k < anchors.size()) AppendEdit(kMatch, &kept_runs);
+        kept_l = l_end + 1;
+        kept_r = r_end + 1;
+    }
+    std::vector<std::pair<uint32_t, uint32_t> >().swap(anchors);
+
+    edits->clear();
+    ReserveScript(prefix + n + m + suffix, edits);
+    AppendRun(kMatch, prefix, edits);
+    size_t l_i = 0, r_i = 0;
+    for (size_t run_i = 0; run_i <= kept_runs.size(); ++run_i) {
+        const bool at_end = run_i == kept_runs.size();
+        const EditRun run = at_end ? EditRun(kMatch, 1) : kept_runs[run_i];
+        for (size_t i = 0; i < run.count; ++i) {
+            // Flush the dropped elements in front of the next kept ones.
+            if (at_end || run.type != kAdd) {
+                const size_t from = l_i;
+                while (l_i < n && !left_shared[l_i]) ++l_i;
+                AppendRun(kRemove, l_i - from, edits);
+            }
+            if (at_end || run.type != kRemove) {
+                const size_t from = r_i;
+                while (r_i < m && !right_shared[r_i]) ++r_i;
+                AppendRun(kAdd, r_i - from, edits);
+            }
+            if (at_end) break;
+            AppendEdit(run.type, edits);
+            l_i += run.type != kAdd;
+            r_i += run.type != kRemove;
+        }
+    }
+    AppendRun(kMatch, suffix, edits);
+}
+
+std::vector<EditType> CalculateOptimalEdits(const std::vector<size_t> &left,
+                                            const std::vector<size_t> &right,
+                                            const DiffOptions &options) {
+    std::vector<EditType> edits;
+    CalculateOptimalEdits(left, right, options, &edits);
+    return edits;
+}
+
+// CalculateOptimalEdits of ids, as edits or as runs.
+template <typename Script>
+void CalculateScript(const std::vector<size_t> &left,
+                     const std::vector<size_t> &right,
+                     const DiffOptions &options, Script *edits) {
+    if (options.algorithm == kSorted &&
+        !SortedOrUnchecked(left, right, options.check_sorted)) {
+        // As for lines, the other options still apply to kMyers.
+        DiffOptions myers = options;
+        myers.algorithm = kMyers;
+        CalculateScript(left, right, myers, edits);
+    } else if (options.algorithm == kSorted) {
+        CalculateSortedEdits(left, right, false, edits);
+    } else if (options.reduce) {
+        Workspace::Buffers *buffers = GetBuffers(options.workspace);
+        buffers->left_ids.assign(left.begin(), left.end());
+        buffers->right_ids.assign(right.begin(), right.end());
+        CalculateReducedEdits(options.algorithm, buffers, edits);
+    } else if (options.algorithm == kWagnerFischer ||
+               options.algorithm == kLinearSpace ||
+               options.algorithm == kParallel) {
+        CalculateDpEdits(left, right, options.algorithm,
+                         GetBuffers(options.workspace), edits);
+    } else {
+        edits->clear();
+        ReserveScript(std::max(left.size(), right.size()), edits);
+        AppendEdits(left.data(), left.size(), right.data(), right.size(),
+                    options.algorithm, GetBuffers(options.workspace), edits);
+    }
+}
+
+void CalculateOptimalEdits(const std::vector<size_t> &left,
+                           const std::vector<size_t> &right,
+                           const DiffOptions &options,
+                           std::vector<EditType> *edits) {
+    CalculateScript(left, right, options, edits);
+}
+
+void CalculateEditRuns(const std::vector<size_t> &left,
+                       const std::vector<size_t> &right,
+                       const DiffOptions &options, std::vector<EditRun> *runs) {
+    CalculateScript(left, right, options, runs);
+}
+
+// Adds 'count' edits of type 'type' to 'counts'.
+void AddEditCount(EditType type, size_t count, EditCounts *counts) {
+    switch (type) {
+        case kMatch:
+            counts->matches += count;
+            break;
+        case kAdd:
+            counts->adds += count;
+            break;
+        case kRemove:
+            counts->removes += count;
+            break;
+        case kReplace:
+            counts->replaces += count;
+            break;
+        case kTranspose:
+            counts->transposes += count;
+            break;
+    }
+}
+
+EditCounts CountEdits(const std::vector<EditRun> &runs) {
+    EditCounts counts;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        AddEditCount(runs[i].type, runs[i].count, &counts);
+    }
+    return counts;
+}
+
+EditCounts CountEdits(const std::vector<EditType> &edits) {
+    EditCounts counts;
+    for (size_t i = 0; i < edits.size(); ++i) {
+        AddEditCount(edits[i], 1, &counts);
+    }
+    return counts;
+}
+
+// Traceback of the band |l_i - r_i| <= width of the DP, stored in a
+// PackedMoves with one row per l_i and one column per diagonal offset.
+class BandMoves {
+   public:
+    BandMoves(size_t rows, size_t width)
+        : width_(width), moves_(rows, 2 * width + 1) {}
+
+    // Storage for the band of DP row l_i + 1; cell r_i of that row is at
+    // column r_i - l_i - 1 + width.
+    uint64_t *row(size_t l_i) { return moves_.row(l_i); }
+
+    EditType Get(size_t l_i, size_t r_i) const {
+        if (l_i == 0) return kAdd;
+        if (r_i == 0) return kRemove;
+        return moves_.Get(l_i, r_i + width_ + 1 - l_i);
+    }
+
+   private:
+    size_t width_;
+    PackedMoves moves_;
+};
+
+bool CalculateBoundedEdits(const std::vector<size_t> &left,
+                           const std::vector<size_t> &right, size_t max_edits,
+                           std::vector<EditType> *edits) {
+    const size_t n = left.size(), m = right.size();
+    if ((n > m ? n - m : m - n) > max_edits) return false;
+    // No script needs more than max(n, m) edits; a larger bound would only
+    // overflow the limit below.
+    max_edits = std::min(max_edits, std::max(n, m));
+    const size_t width = max_edits;
+    const Cost unit = CostUnit(n, m);
+    // A cost of (max_edits + 1) * unit or more means more than max_edits
+    // edits; see CostUnit. Cells outside the band never win a comparison.
+    const Cost limit = (max_edits + 1) * unit;
+    const Cost outside = std::numeric_limits<Cost>::max() / 4;
+
+    // band[width + r_i - l_i] is the cost of cell (l_i, r_i) of the current
+    // row, with one sentinel on each side.
+    std::vector<Cost> prev(2 * width + 3, outside), band(2 * width + 3);
+    for (size_t r_i = 0; r_i <= std::min(m, width); ++r_i) {
+        prev[width + 1 + r_i] = r_i * unit;
+    }
+    BandMoves best_move(n, width);
+    for (size_t l_i = 1; l_i <= n; ++l_i) {
+        std::fill(band.begin(), band.end(), outside);
+        const size_t begin = l_i > width ? l_i - width : 0;
+        const size_t end = std::min(m, l_i + width);
+        Cost row_min = outside;
+        if (begin == 0) {
+            band[width + 1 - l_i] = l_i * unit;
+            row_min = l_i * unit;
+        }
+        uint64_t *out = best_move.row(l_i - 1);
+        for (size_t r_i = std::max<size_t>(begin, 1); r_i <= end; ++r_i) {
+            const size_t k = width + 1 + r_i - l_i;
+            const EditType move =
+                ChooseMove(left[l_i - 1] == right[r_i - 1], band[k - 1],
+                           prev[k + 1], prev[k], unit, &band[k]);
+            const size_t cell = k - 1;
+            out[cell / PackedMoves::kCellsPerWord] |=
+                static_cast<uint64_t>(move)
+                << (cell % PackedMoves::kCellsPerWord * 2);
+            row_min = std::min(row_min, band[k]);
+        }
+        // Costs never decrease along a path, so the final cost is at least
+        // the minimum of any row.
+        if (row_min >= limit) return false;
+        prev.swap(band);
+    }
+    if (prev[width + 1 + m - n] >= limit) return false;
+
+    edits->clear();
+    AppendTraceback(best_move, n, m, edits);
+    std::reverse(edits->begin(), edits->end());
+    return true;
+}
+
+// Levenshtein distance restricted to the band |l_i - r_i| <= max_distance.
+// Returns max_distance + 1 as soon as a whole row exceeds max_distance.
+template <typename Sequence>
+size_t BandedDistance(Sequence left, Sequence right, size_t max_distance) {
+    size_t n = left.size(), m = right.size();
+    if ((n > m ? n - m : m - n) > max_distance) return max_distance + 1;
+    // The distance is at most max(n, m), so a larger bound changes nothing
+    // and would overflow 'outside'. Clamped, the bound is only exceeded
+    // when it was below max(n, m), so 'outside' is max_distance + 1 then.
+    max_distance = std::min(max_distance, std::max(n, m));
+    const size_t width = max_distance;
+    const size_t outside = max_distance + 1;
+
+    // Same layout as in CalculateBoundedEdits, with saturated unit costs.
+    std::vector<size_t> prev(2 * width + 3, outside), band(2 * width + 3);
+    for (size_t r_i = 0; r_i <= std::min(m, width); ++r_i) {
+        prev[width + 1 + r_i] = r_i;
+    }
+    for (size_t l_i = 1; l_i <= n; ++l_i) {
+        std::fill(band.begin(), band.end(), outside);
+        const size_t begin = l_i > width ? l_i - width : 0;
+        const size_t end = std::min(m, l_i + width);
+        size_t row_min = outside;
+        if (begin == 0) {
+            band[width + 1 - l_i] = row_min = l_i;
+        }
+        for (size_t r_i = std::max<size_t>(begin, 1); r_i <= end; ++r_i) {
+            const size_t k = width + 1 + r_i - l_i;
+            const size_t cost = std::min(
+                std::min(band[k - 1], prev[k + 1]) + 1,
+                prev[k] + (left[l_i - 1] == right[r_i - 1] ? 0 : 1));
+            band[k] = std::min(cost, outside);
+            row_min = std::min(row_min, band[k]);
+        }
+        if (row_min > max_distance) return outside;
+        prev.swap(band);
+    }
+    return prev[width + 1 + m - n];
+}
+
+size_t BoundedDistance(std::string_view left, std::string_view right,
+                       size_t max_distance) {
+    return BandedDistance(left, right, max_distance);
+}
+
+size_t BoundedDistance(const std::vector<size_t> &left,
+                       const std::vector<size_t> &right, size_t max_distance) {
+    return BandedDistance<const std::vector<size_t> &>(left, right,
+                                                       max_distance);
+}
+
+// Bit-parallel Levenshtein distance of Myers (1999) in the blocked form of
+// Hyyrö (2003). Column j of the DP over 'pattern' is kept as vertical deltas
+// (+1 in 'vp', -1 in 'vn') packed 64 rows per word, and one text symbol
+// updates a whole word with a handful of operations. 'peq' holds, for each
+// symbol s and word w, peq[s * words + w] = bitmask of pattern rows equal to
+// s. Text symbols must index into 'peq'.
+// With kTranspositions, this is the optimal string alignment distance
+// instead, by Hyyrö's extension: a row whose symbol matched the previous
+// text symbol, with the row above matching this one, also moves diagonally
+// from two columns back. The blocked form keeps its words in 'deltas'.
+template <bool kTranspositions, typename Symbol>
+size_t BitParallelDistance(size_t pattern_size, const Symbol *text,
+                           size_t text_size, const uint64_t *peq,
+                           std::vector<uint64_t> *deltas) {
+    const size_t words = (pattern_size + 63) / 64;
+    const uint64_t last = uint64_t(1) << ((pattern_size - 1) % 64);
+    size_t distance = pattern_size;
+
+    if (words == 1) {
+        uint64_t vp = ~uint64_t(0), vn = 0, d0 = 0, prev_eq = 0;
+        for (size_t j = 0; j < text_size; ++j) {
+            const uint64_t eq = peq[text[j]];
+            const uint64_t transposed =
+                kTranspositions ? ((~d0 & eq) << 1) & prev_eq : 0;
+            d0 = (((eq & vp) + vp) ^ vp) | eq | vn | transposed;
+            uint64_t hp = vn | ~(d0 | vp);
+            uint64_t hn = d0 & vp;
+            distance += (hp & last) != 0;
+            distance -= (hn & last) != 0;
+            // Row 0 of the DP grows by one per text symbol.
+            hp = (hp << 1) | 1;
+            hn <<= 1;
+            vp = hn | ~(d0 | hp);
+            vn = hp & d0;
+            prev_eq = eq;
+        }
+        return distance;
+    }
+
+    // The previous d0 of each word, for kTranspositions, and the previous
+    // text symbol's masks.
+    deltas->assign(3 * words, 0);
+    uint64_t *vp = deltas->data(), *vn = vp + words, *d0s = vn + words;
+    std::fill(vp, vp + words, ~uint64_t(0));
+    const uint64_t *prev_eqs = NULL;
+    for (size_t j = 0; j < text_size; ++j) {
+        const uint64_t *eqs = peq + text[j] * words;
+        uint64_t hp_carry = 1, hn_carry = 0, transposed_carry = 0;
+        for (size_t w = 0; w < words; ++w) {
+            // A -1 entering from the word above acts like a match on its
+            // first row.
+            const uint64_t eq = eqs[w] | hn_carry;
+            uint64_t d0 = (((eq & vp[w]) + vp[w]) ^ vp[w]) | eq | vn[w];
+            if (kTranspositions) {
+                const uint64_t candidates = ~d0s[w] & eqs[w];
+                if (prev_eqs) {
+                    d0 |= ((candidates << 1) | transposed_carry) &
+                          prev_eqs[w];
+                }
+                transposed_carry = candidates >> 63;
+                d0s[w] = d0;
+            }
+            uint64_t hp = vn[w] | ~(d0 | vp[w]);
+            uint64_t hn = d0 & vp[w];
+            const uint64_t hp_in = hp_carry, hn_in = hn_carry;
+            if (w + 1 < words) {
+                hp_carry = hp >> 63;
+                hn_carry = hn >> 63;
+            } else {
+                distance += (hp & last) != 0;
+                distance -= (hn & last) != 0;
+            }
+            hp = (hp << 1) | hp_in;
+            hn = (hn << 1) | hn_in;
+            vp[w] = hn | ~(d0 | hp);
+            vn[w] = hp & d0;
+        }
+        prev_eqs = eqs;
+    }
+    return distance;
+}
+
+template <bool kTranspositions>
+size_t StringDistance(std::string_view left, std::string_view right,
+                      Workspace::Buffers *buffers) {
+    // Common ends never contribute to the distance.
+    while (!left.empty() && !right.empty() && left.front() == right.front()) {
+        left.remove_prefix(1);
+        right.remove_prefix(1);
+    }
+    while (!left.empty() && !right.empty() && left.back() == right.back()) {
+        left.remove_suffix(1);
+        right.remove_suffix(1);
+    }
+    // The shorter side is the pattern, so it takes fewer words.
+    if (left.size() < right.size()) std::swap(left, right);
+    if (right.empty()) return left.size();
+
+    const size_t words = (right.size() + 63) / 64;
+    std::vector<uint64_t> &peq = buffers->peq;
+    if (peq.size() < 256 * words) peq.resize(256 * words);
+    for (size_t i = 0; i < right.size(); ++i) {
+        peq[static_cast<unsigned char>(right[i]) * words + i / 64] |=
+            uint64_t(1) << (i % 64);
+    }
+    const size_t distance = BitParallelDistance<kTranspositions>(
+        right.size(), reinterpret_cast<const unsigned char *>(left.data()),
+        left.size(), peq.data(), &buffers->deltas);
+    for (size_t i = 0; i < right.size(); ++i) {
+        peq[static_cast<unsigned char>(right[i]) * words + i / 64] = 0;
+    }
+    return distance;
+}
+
+template <bool kTranspositions>
+size_t IdDistance(const std::vector<size_t> &left,
+                  const std::vector<size_t> &right,
+                  Workspace::Buffers *buffers) {
+    const std::vector<size_t> &pattern =
+        left.size() < right.size() ? left : right;
+    const std::vector<size_t> &text = left.size() < right.size() ? right : left;
+    if (pattern.empty()) return text.size();
+
+    // Number the pattern symbols densely; text symbols absent from the
+    // pattern share the last, all-zero, row of 'peq'.
+    std::vector<size_t> &symbols = buffers->symbols;
+    symbols.assign(pattern.begin(), pattern.end());
+    std::sort(symbols.begin(), symbols.end());
+    symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+    const size_t words = (pattern.size() + 63) / 64;
+    std::vector<uint64_t> &peq = buffers->peq;
+    if (peq.size() < (symbols.size() + 1) * words) {
+        peq.resize((symbols.size() + 1) * words);
+    }
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        const size_t s = std::lower_bound(symbols.begin(), symbols.end(),
+                                          pattern[i]) -
+                         symbols.begin();
+        peq[s * words + i / 64] |= uint64_t(1) << (i % 64);
+    }
+    std::vector<uint32_t> &dense_text = buffers->dense_text;
+    dense_text.resize(text.size());
+    for (size_t j = 0; j < text.size(); ++j) {
+        std::vector<size_t>::const_iterator it =
+            std::lower_bound(symbols.begin(), symbols.end(), text[j]);
+        dense_text[j] = static_cast<uint32_t>(
+            it != symbols.end() && *it == text[j] ? it - symbols.begin()
+                                                  : symbols.size());
+    }
+    const size_t distance = BitParallelDistance<kTranspositions>(
+        pattern.size(), dense_text.data(), dense_text.size(), peq.data(),
+        &buffers->deltas);
+    std::memset(peq.data(), 0, (symbols.size() + 1) * words * sizeof(uint64_t));
+    return distance;
+}
+
+size_t Distance(std::string_view left, std::string_view right,
+                Workspace *workspace) {
+    return StringDistance<false>(left, right, GetBuffers(workspace));
+}
+
+size_t Distance(const std::vector<size_t> &left,
+                const std::vector<size_t> &right, Workspace *workspace) {
+    return IdDistance<false>(left, right, GetBuffers(workspace));
+}
+
+size_t TranspositionDistance(std::string_view left, std::string_view right,
+                             Workspace *workspace) {
+    return StringDistance<true>(left, right, GetBuffers(workspace));
+}
+
+size_t TranspositionDistance(const std::vector<size_t> &left,
+                             const std::vector<size_t> &right,
+                             Workspace *workspace) {
+    return IdDistance<true>(left, right, GetBuffers(workspace));
+}
+
+// The optimal string alignment DP: unit costs, with kTranspose taking two
+// adjacent elements that appear swapped on the other side. Keeps
+// three rows of costs, as a transposition looks two rows back, and one
+// move per cell. Ties go to the diagonal, then to kTranspose, kAdd and
+// kRemove.
+template <typename Sequence>
+std::vector<EditType> CalculateTranspositionEditsOf(const Sequence &left,
+                                                    const Sequence &right) {
+    const size_t rows = left.size() + 1, cols = right.size() + 1;
+    std::vector<size_t> costs(3 * cols);
+    std::vector<unsigned char> moves(rows * cols);
+    for (size_t r_i = 0; r_i < cols; ++r_i) {
+        costs[r_i] = r_i;
+        moves[r_i] = kAdd;
+    }
+    for (size_t l_i = 1; l_i < rows; ++l_i) {
+        size_t *row = &costs[l_i % 3 * cols];
+        const size_t *prev = &costs[(l_i - 1) % 3 * cols];
+        const size_t *prev2 = &costs[(l_i + 1) % 3 * cols];
+        row[0] = l_i;
+        moves[l_i * cols] = kRemove;
+        for (size_t r_i = 1; r_i < cols; ++r_i) {
+            const bool match = left[l_i - 1] == right[r_i - 1];
+            size_t cost = prev[r_i - 1] + !match;
+            EditType move = match ? kMatch : kReplace;
+            if (!match && l_i > 1 && r_i > 1 &&
+                left[l_i - 1] == right[r_i - 2] &&
+                left[l_i - 2] == right[r_i - 1] &&
+                prev2[r_i - 2] + 1 < cost) {
+                cost = prev2[r_i - 2] + 1;
+                move = kTranspose;
+            }
+            if (row[r_i - 1] + 1 < cost) {
+                cost = row[r_i - 1] + 1;
+                move = kAdd;
+            }
+            if (prev[r_i] + 1 < cost) {
+                cost = prev[r_i] + 1;
+                move = kRemove;
+            }
+            row[r_i] = cost;
+            moves[l_i * cols + r_i] = move;
+        }
+    }
+
+    std::vector<EditType> path;
+    for (size_t l_i = rows - 1, r_i = cols - 1; l_i > 0 || r_i > 0;) {
+        const EditType move =
+            static_cast<EditType>(moves[l_i * cols + r_i]);
+        path.push_back(move);
+        const size_t step = move == kTranspose ? 2 : 1;
+        l_i -= move != kAdd ? step : 0;
+        r_i -= move != kRemove ? step : 0;
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+std::vector<EditType> CalculateTranspositionEdits(
+    const std::vector<size_t> &left, const std::vector<size_t> &right) {
+    return CalculateTranspositionEditsOf(left, right);
+}
+
+std::vector<EditType> CalculateTranspositionEdits(std::string_view left,
+                                                  std::string_view right) {
+    return CalculateTranspositionEditsOf(left, right);
+}
+
+// 64-bit hash of a line, 8 bytes at a time.
+inline uint64_t HashLine(std::string_view line) {
+    const uint64_t kMul = 0x9E3779B97F4A7C15ULL;
+    uint64_t hash = line.size() * kMul;
+    const char *p = line.data();
+    size_t size = line.size();
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        hash = (hash ^ word) * kMul;
+        hash ^= hash >> 29;
+    }
+    uint64_t tail = 0;
+    if (size > 0) std::memcpy(&tail, p, size);
+    hash = (hash ^ tail) * kMul;
+    return hash ^ (hash >> 32);
+}
+
+// Helper class to convert string into ids with de-duplication.
+// Open addressing over the line hashes; the table refers to the caller's
+// lines and copies none of them, so they must outlive it. A slot is only a
+// 32-bit hash tag and a 32-bit id, so that large inputs keep the table
+// small and mostly in cache; equal tags are confirmed by comparing the
+// lines, found through the position of the first occurrence of each id in
+// 'left', then 'right', then 'third' when there is one (see Merge3).
+// The table lives in the caller's 'slots' and 'positions'. Inputs of 2^32 - 1
+// lines or more, which the 32-bit ids and positions cannot number, go to a
+// std::unordered_map of the lines instead.
+template <typename Line>
+class InternalStrings {
+   public:
+    InternalStrings(const std::vector<Line> &left,
+                    const std::vector<Line> &right,
+                    std::vector<InternSlot> *slots,
+                    std::vector<uint32_t> *positions,
+                    const std::vector<Line> *third = NULL)
+        : left_(left),
+          right_(right),
+          third_(third),
+          mask_(15),
+          slots_(*slots),
+          positions_(*positions) {
+        const size_t lines =
+            left.size() + right.size() + (third ? third->size() : 0);
+        wide_ = lines >= UINT32_MAX;
+        if (wide_) {
+            slots_.clear();
+            positions_.clear();
+            return;
+        }
+        // Below 2/3 full.
+        while (mask_ + 1 < lines + lines / 2) mask_ = mask_ * 2 + 1;
+        slots_.assign(mask_ + 1, InternSlot());
+        positions_.clear();
+    }
+
+    // Returns the id of the line at 'position'.
+    size_t GetId(size_t position) {
+        const std::string_view str = line(position);
+        if (wide_) {
+            return wide_ids_.emplace(str, wide_ids_.size()).first->second;
+        }
+        const uint64_t hash = HashLine(str);
+        const uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        for (size_t i = hash & mask_;; i = (i + 1) & mask_) {
+            InternSlot &slot = slots_[i];
+            if (slot.id == 0) {
+                slot.tag = tag;
+                positions_.push_back(static_cast<uint32_t>(position));
+                slot.id = static_cast<uint32_t>(positions_.size());
+                return slot.id - 1;
+            }
+            if (slot.tag == tag && line(positions_[slot.id - 1]) == str) {
+                return slot.id - 1;
+            }
+        }
+    }
+
+   private:
+    std::string_view line(size_t position) const {
+        if (position < left_.size()) return left_[position];
+        position -= left_.size();
+        return position < right_.size() ? right_[position]
+                                        : (*third_)[position - right_.size()];
+    }
+
+    const std::vector<Line> &left_, &right_;
+    const std::vector<Line> *third_;
+    size_t mask_;
+    std::vector<InternSlot> &slots_;
+    // The first position of each id.
+    std::vector<uint32_t> &positions_;
+    // Whether the lines are too many for the table, and their ids then.
+    bool wide_;
+    std::unordered_map<std::string_view, size_t> wide_ids_;
+};
+
+// Converts both sides to ids, equal strings getting equal ids, with the
+// intern table in 'buffers'.
+template <typename Line>
+void InternLines(const std::vector<Line> &left, const std::vector<Line> &right,
+                 Workspace::Buffers *buffers, std::vector<size_t> *left_ids,
+                 std::vector<size_t> *right_ids) {
+    InternalStrings<Line> intern_table(left, right, &buffers->slots,
+                                       &buffers->positions);
+    left_ids->resize(left.size());
+    for (size_t i = 0; i < left.size(); ++i) {
+        (*left_ids)[i] = intern_table.GetId(i);
+    }
+    right_ids->resize(right.size());
+    for (size_t i = 0; i < right.size(); ++i) {
+        (*right_ids)[i] = intern_table.GetId(left.size() + i);
+    }
+}
+
+// CalculateOptimalEdits of lines, with the ids in the workspace, where the
+// reduction compacts them.
+template <typename Line, typename Script>
+void CalculateLineEdits(const std::vector<Line> &left,
+                        const std::vector<Line> &right,
+                        const DiffOptions &options, Script *edits) {
+    // Sorted lines are merged as they are: their ids would not be sorted.
+    if (options.algorithm == kSorted) {
+        if (!SortedOrUnchecked(left, right, options.check_sorted)) {
+            DiffOptions myers = options;
+            myers.algorithm = kMyers;
+            CalculateLineEdits(left, right, myers, edits);
+            return;
+        }
+        edits->clear();
+        ReserveScript(left.size() + right.size(), edits);
+        AppendSortedEdits(left.data(), left.size(), right.data(),
+                          right.size(), edits);
+        return;
+    }
+    Workspace::Buffers *buffers = GetBuffers(options.workspace);
+    std::vector<size_t> &left_ids = buffers->left_ids;
+    std::vector<size_t> &right_ids = buffers->right_ids;
+    InternLines(left, right, buffers, &left_ids, &right_ids);
+    if (options.reduce) {
+        CalculateReducedEdits(options.algorithm, buffers, edits);
+        return;
+    }
+    CalculateScript(left_ids, right_ids, options, edits);
+}
+
+std::vector<EditType> CalculateOptimalEdits(
+    const std::vector<std::string> &left,
+    const std::vector<std::string> &right, const DiffOptions &options) {
+    std::vector<EditType> edits;
+    CalculateLineEdits(left, right, options, &edits);
+    return edits;
+}
+
+std::vector<EditType> CalculateOptimalEdits(
+    const std::vector<std::string_view> &left,
+    const std::vector<std::string_view> &right, const DiffOptions &options) {
+    std::vector<EditType> edits;
+    CalculateLineEdits(left, right, options, &edits);
+    return edits;
+}
+
+void CalculateOptimalEdits(const std::vector<std::string> &left,
+                           const std::vector<std::string> &right,
+                           const DiffOptions &options,
+                           std::vector<EditType> *edits) {
+    CalculateLineEdits(left, right, options, edits);
+}
+
+void CalculateOptimalEdits(const std::vector<std::string_view> &left,
+                           const std::vector<std::string_view> &right,
+                           const DiffOptions &options,
+                           std::vector<EditType> *edits) {
+    CalculateLineEdits(left, right, options, edits);
+}
+
+void CalculateEditRuns(const std::vector<std::string> &left,
+                       const std::vector<std::string> &right,
+                       const DiffOptions &options, std::vector<EditRun> *runs) {
+    CalculateLineEdits(left, right, options, runs);
+}
+
+void CalculateEditRuns(const std::vector<std::string_view> &left,
+                       const std::vector<std::string_view> &right,
+                       const DiffOptions &options, std::vector<EditRun> *runs) {
+    CalculateLineEdits(left, right, options, runs);
+}
+
+std::vector<EditType> CalculateOptimalEdits(
+    const std::vector<std::string> &left,
+    const std::vector<std::string> &right, Algorithm algorithm) {
+    DiffOptions options;
+    options.algorithm = algorithm;
+    return CalculateOptimalEdits(left, right, options);
+}
+
+std::vector<EditType> CalculateOptimalEdits(
+    const std::vector<std::string_view> &left,
+    const std::vector<std::string_view> &right, Algorithm algorithm) {
+    DiffOptions options;
+    options.algorithm = algorithm;
+    return CalculateOptimalEdits(left, right, options);
+}
+
+bool CalculateBoundedEdits(const std::vector<std::string> &left,
+                           const std::vector<std::string> &right,
+                           size_t max_edits, std::vector<EditType> *edits,
+                           Workspace *workspace) {
+    Workspace::Buffers *buffers = GetBuffers(workspace);
+    InternLines(left, right, buffers, &buffers->left_ids, &buffers->right_ids);
+    return CalculateBoundedEdits(buffers->left_ids, buffers->right_ids,
+                                 max_edits, edits);
+}
+
+// Collects the output of WriteUnifiedDiff and hands it to the writer in
+// blocks of about kOutputBlockSize bytes.
+class OutputBuffer {
+   public:
+    static const size_t kOutputBlockSize = 1 << 16;
+
+    explicit OutputBuffer(const DiffWriter &write) : write_(write) {
+        block_.reserve(kOutputBlockSize + 1024);
+    }
+    ~OutputBuffer() { Flush(); }
+
+    void Append(std::string_view text) {
+        block_.append(text.data(), text.size());
+        if (block_.size() >= kOutputBlockSize) Flush();
+    }
+    void Append(char c) { block_.push_back(c); }
+    void Append(size_t number) {
+        char digits[24];
+        const int size = std::snprintf(digits, sizeof(digits), "%zu", number);
+        block_.append(digits, size);
+    }
+
+    void Flush() {
+        if (block_.empty()) return;
+        write_(block_);
+        block_.clear();
+    }
+
+   private:
+    const DiffWriter &write_;
+    std::string block_;
+};
+
+// Edits of the intraline diff of a pair of lines beyond which the whole
+// middle of the pair is marked.
+const size_t kIntralineMaxEdits = 8;
+
+// Splits 'line' into the tokens of 'mode', with 'ids' equal for equal
+// tokens and 'offsets' the start of each token followed by the line size.
+void TokenizeLine(std::string_view line, Intraline mode,
+                  std::vector<size_t> *ids, std::vector<size_t> *offsets) {
+    ids->clear();
+    offsets->clear();
+    for (size_t begin = 0, end; begin < line.size(); begin = end) {
+        end = begin + 1;
+        if (mode == kIntralineWords) {
+            const unsigned char c = line[begin];
+            if (isalnum(c) || c == '_') {
+                while (end < line.size() &&
+                       (isalnum(static_cast<unsigned char>(line[end])) ||
+                        line[end] == '_')) {
+                    ++end;
+                }
+            }
+        }
+        offsets->push_back(begin);
+        ids->push_back(end - begin == 1
+                           ? static_cast<unsigned char>(line[begin])
+                           : HashLine(line.substr(begin, end - begin)));
+    }
+    offsets->push_back(line.size());
+}
+
+// Helper class that holds the state for one hunk and prints it out to the
+// stream.
+// It reorders adds/removes when possible to group all removes before all
+// adds. It also adds the hunk header before printint into the stream.
+// The lines live in vectors that keep their capacity from one hunk to the
+// next, see Reset.
+class Hunk {
+   public:
+    explicit Hunk(Intraline intraline)
+        : intraline_(intraline),
+          left_start_(),
+          right_start_(),
+          adds_(),
+          removes_(),
+          common_() {}
+
+    void Reset(size_t left_start, size_t right_start) {
+        left_start_ = left_start;
+        right_start_ = right_start;
+        adds_ = removes_ = common_ = 0;
+        hunk_.clear();
+        hunk_adds_.clear();
+        hunk_removes_.clear();
+        marks_.clear();
+    }
+
+    void PushLine(char edit, std::string_view line) {
+        switch (edit) {
+            case ' ':
+                ++common_;
+                FlushEdits();
+                hunk_.push_back(HunkLine(' ', line));
+                break;
+            case '-':
+                ++removes_;
+                hunk_removes_.push_back(HunkLine('-', line));
+                break;
+            case '+':
+                ++adds_;
+                hunk_adds_.push_back(HunkLine('+', line));
+                break;
+        }
+    }
+
+    void PrintTo(OutputBuffer *out) {
+        PrintHeader(out);
+        FlushEdits();
+        for (size_t i = 0; i < hunk_.size(); ++i) {
+            const HunkLine &line = hunk_[i];
+            out->Append(line.edit);
+            // The marked ranges, in order, split the line.
+            size_t done = 0;
+            for (size_t m = line.marks_begin; m < line.marks_end; ++m) {
+                const std::pair<size_t, size_t> &mark = marks_[m];
+                out->Append(line.text.substr(done, mark.first - done));
+                out->Append(line.edit == '-' ? "[-" : "{+");
+                out->Append(
+                    line.text.substr(mark.first, mark.second - mark.first));
+                out->Append(line.edit == '-' ? "-]" : "+}");
+                done = mark.second;
+            }
+            out->Append(line.text.substr(done));
+            out->Append('\n');
+        }
+    }
+
+    bool has_edits() const { return adds_ || removes_; }
+
+   private:
+    // A line of the hunk, with the ranges marks_[marks_begin, marks_end) of
+    // its text that the intraline diff marked.
+    struct HunkLine {
+        HunkLine(char edit, std::string_view text)
+            : edit(edit), text(text), marks_begin(0), marks_end(0) {}
+
+        char edit;
+        std::string_view text;
+        size_t marks_begin, marks_end;
+    };
+
+    void FlushEdits() {
+        if (intraline_ != kNoIntraline &&
+            hunk_removes_.size() == hunk_adds_.size()) {
+            for (size_t i = 0; i < hunk_removes_.size(); ++i) {
+                MarkChanges(&hunk_removes_[i], &hunk_adds_[i]);
+            }
+        }
+        hunk_.insert(hunk_.end(), hunk_removes_.begin(), hunk_removes_.end());
+        hunk_.insert(hunk_.end(), hunk_adds_.begin(), hunk_adds_.end());
+        hunk_removes_.clear();
+        hunk_adds_.clear();
+    }
+
+    // Diffs the tokens of a removed and an added line and records the
+    // changed ranges of each. The common start and end are skipped in
+    // linear time; the rest goes through the banded DP, and is marked as a
+    // whole when it takes more than kIntralineMaxEdits edits.
+    void MarkChanges(HunkLine *removed, HunkLine *added) {
+        TokenizeLine(removed->text, intraline_, &left_ids_, &left_offsets_);
+        TokenizeLine(added->text, intraline_, &right_ids_, &right_offsets_);
+        size_t prefix = 0, suffix = 0;
+        while (prefix < left_ids_.size() && prefix < right_ids_.size() &&
+               left_ids_[prefix] == right_ids_[prefix]) {
+            ++prefix;
+        }
+        while (suffix < left_ids_.size() - prefix &&
+               suffix < right_ids_.size() - prefix &&
+               left_ids_[left_ids_.size() - 1 - suffix] ==
+                   right_ids_[right_ids_.size() - 1 - suffix]) {
+            ++suffix;
+        }
+        left_ids_.erase(left_ids_.end() - suffix, left_ids_.end());
+        left_ids_.erase(left_ids_.begin(), left_ids_.begin() + prefix);
+        right_ids_.erase(right_ids_.end() - suffix, right_ids_.end());
+        right_ids_.erase(right_ids_.begin(), right_ids_.begin() + prefix);
+
+        edits_.clear();
+        if (!CalculateBoundedEdits(left_ids_, right_ids_, kIntralineMaxEdits,
+                                   &edits_)) {
+            // Everything in the middle changed, as far as we can tell.
+            edits_.assign(left_ids_.size(), kRemove);
+            edits_.insert(edits_.end(), right_ids_.size(), kAdd);
+        }
+
+        removed->marks_begin = marks_.size();
+        AddMarks(left_offsets_, prefix, kAdd);
+        removed->marks_end = marks_.size();
+        added->marks_begin = marks_.size();
+        AddMarks(right_offsets_, prefix, kRemove);
+        added->marks_end = marks_.size();
+    }
+
+    // Appends to marks_ the byte ranges of the tokens of one side that
+    // edits_ changes, merging adjacent ones. 'other' is the edit that only
+    // moves on the other side.
+    void AddMarks(const std::vector<size_t> &offsets, size_t token,
+                  EditType other) {
+        bool open = false;
+        for (size_t i = 0; i < edits_.size(); ++i) {
+            if (edits_[i] == other) continue;
+            if (edits_[i] == kMatch) {
+                open = false;
+            } else if (open) {
+                marks_.back().second = offsets[token + 1];
+            } else {
+                marks_.push_back(
+                    std::make_pair(offsets[token], offsets[token + 1]));
+                open = true;
+            }
+            ++token;
+        }
+    }
+
+    // Print a unified diff header for one hunk.
+    // The format is
+    //   "@@ -<left_start>,<left_length> +<right_start>,<right_length> @@"
+    // where the left/right parts are omitted if unnecessary.
+    void PrintHeader(OutputBuffer *out) const {
+        out->Append("@@ ");
+        if (removes_) {
+            out->Append('-');
+            out->Append(left_start_);
+            out->Append(',');
+            out->Append(removes_ + common_);
+        }
+        if (removes_ && adds_) {
+            out->Append(' ');
+        }
+        if (adds_) {
+            out->Append('+');
+            out->Append(right_start_);
+            out->Append(',');
+            out->Append(adds_ + common_);
+        }
+        out->Append(" @@\n");
+    }
+
+    typedef std::vector<HunkLine> Lines;
+
+    const Intraline intraline_;
+    size_t left_start_, right_start_;
+    size_t adds_, removes_, common_;
+    Lines hunk_, hunk_adds_, hunk_removes_;
+    // The marked byte ranges of all the lines, and the scratch space of the
+    // intraline diff.
+    std::vector<std::pair<size_t, size_t> > marks_;
+    std::vector<size_t> left_ids_, right_ids_, left_offsets_, right_offsets_;
+    std::vector<EditType> edits_;
+};
+
+// Create a list of diff hunks in Unified diff format.
+// Each hunk has a header generated by PrintHeader above plus a body with
+// lines prefixed with ' ' for no change, '-' for deletion and '+' for
+// addition.
+// 'options.context' represents the desired unchanged prefix/suffix around
+// the diff.
+// If two hunks are close enough that their contexts overlap, then they are
+// joined into one hunk.
+// The runs of matches are skipped whole, so the time spent outside the
+// hunks is linear in the number of runs, not of lines.
+template <typename Line>
+void WriteHunks(const std::vector<Line> &left, const std::vector<Line> &right,
+                const std::vector<EditRun> &runs, const DiffOptions &options,
+                OutputBuffer *out) {
+    const size_t context = options.context;
+    size_t l_i = 0, r_i = 0, run_i = 0;
+    // Edits of runs[run_i] already walked.
+    size_t done = 0;
+    Hunk hunk(options.intraline);
+    while (run_i < runs.size()) {
+        // Find first edit. Runs alternate, so it starts the next run.
+        if (runs[run_i].type == kMatch) {
+            l_i += runs[run_i].count - done;
+            r_i += runs[run_i].count - done;
+            ++run_i;
+            done = 0;
+        }
+
+        // Find the first line to include in the hunk.
+        const size_t prefix_context = std::min(l_i, context);
+        hunk.Reset(l_i - prefix_context + 1, r_i - prefix_context + 1);
+        for (size_t i = prefix_context; i > 0; --i) {
+            hunk.PushLine(' ', left[l_i - i]);
+        }
+
+        // Iterate the runs until we found enough suffix for the hunk or the
+        // input is over.
+        while (run_i < runs.size()) {
+            const EditRun &run = runs[run_i];
+            size_t count = run.count;
+            bool hunk_done = false;
+            if (run.type == kMatch && count >= context) {
+                // Continue only if the next hunk is very close. With no
+                // context, only an edit right here continues it.
+                hunk_done = run_i + 1 == runs.size() ||
+                            count - context >= std::max<size_t>(context, 1);
+                if (hunk_done) count = context;
+            }
+
+            for (size_t i = 0; i < count; ++i) {
+                const EditType edit = run.type;
+                if (edit == kMatch || edit == kRemove || edit == kReplace) {
+                    hunk.PushLine(edit == kMatch ? ' ' : '-', left[l_i]);
+                }
+                if (edit == kAdd || edit == kReplace) {
+                    hunk.PushLine('+', right[r_i]);
+                }
+
+                // Advance indices, depending on edit type.
+                l_i += edit != kAdd;
+                r_i += edit != kRemove;
+            }
+            done = count;
+            if (done == run.count) {
+                ++run_i;
+                done = 0;
+            }
+            if (hunk_done) break;
+        }
+
+        if (!hunk.has_edits()) {
+            // We are done. We don't want this hunk.
+            break;
+        }
+
+        hunk.PrintTo(out);
+    }
+}
+
+template <typename Line>
+void WriteUnifiedDiffOf(const std::vector<Line> &left,
+                        const std::vector<Line> &right,
+                        const DiffOptions &options, const DiffWriter &write) {
+    std::vector<EditRun> runs;
+    CalculateLineEdits(left, right, options, &runs);
+    OutputBuffer out(write);
+    WriteHunks(left, right, runs, options, &out);
+}
+
+void WriteUnifiedDiff(const std::vector<std::string> &left,
+                      const std::vector<std::string> &right,
+                      const DiffOptions &options, const DiffWriter &write) {
+    WriteUnifiedDiffOf(left, right, options, write);
+}
+
+void WriteUnifiedDiff(const std::vector<std::string_view> &left,
+                      const std::vector<std::string_view> &right,
+                      const DiffOptions &options, const DiffWriter &write) {
+    WriteUnifiedDiffOf(left, right, options, write);
+}
+
+void WriteUnifiedDiff(const std::vector<std::string> &left,
+                      const std::vector<std::string> &right,
+                      const DiffOptions &options, std::ostream *os) {
+    WriteUnifiedDiffOf(left, right, options, [os](std::string_view block) {
+        os->write(block.data(), block.size());
+    });
+}
+
+void WriteUnifiedDiff(const std::vector<std::string_view> &left,
+                      const std::vector<std::string_view> &right,
+                      const DiffOptions &options, std::ostream *os) {
+    WriteUnifiedDiffOf(left, right, options, [os](std::string_view block) {
+        os->write(block.data(), block.size());
+    });
+}
+
+void WriteUnifiedDiff(const std::vector<std::string> &left,
+                      const std::vector<std::string> &right,
+                      const DiffOptions &options, FILE *file) {
+    WriteUnifiedDiffOf(left, right, options, [file](std::string_view block) {
+        std::fwrite(block.data(), 1, block.size(), file);
+    });
+}
+
+void WriteUnifiedDiff(const std::vector<std::string_view> &left,
+                      const std::vector<std::string_view> &right,
+                      const DiffOptions &options, FILE *file) {
+    WriteUnifiedDiffOf(left, right, options, [file](std::string_view block) {
+        std::fwrite(block.data(), 1, block.size(), file);
+    });
+}
+
+std::string CreateUnifiedDiff(const std::vector<std::string> &left,
+                              const std::vector<std::string> &right,
+                              const DiffOptions &options) {
+    std::string diff;
+    WriteUnifiedDiff(left, right, options, [&diff](std::string_view block) {
+        diff.append(block.data(), block.size());
+    });
+    return diff;
+}
+
+std::string CreateUnifiedDiff(const std::vector<std::string> &left,
+                              const std::vector<std::string> &right,
+                              size_t context, Algorithm algorithm) {
+    DiffOptions options;
+    options.context = context;
+    options.algorithm = algorithm;
+    return CreateUnifiedDiff(left, right, options);
+}
+
+// Marks a base line that the other side does not match in MatchBaseLines.
+const size_t kUnmatched = static_cast<size_t>(-1);
+
+// Stores in 'matches' the line of the other side that 'edits' matches with
+// each of 'base_size' base lines, or kUnmatched.
+void MatchBaseLines(const std::vector<EditType> &edits, size_t base_size,
+                    std::vector<size_t> *matches) {
+    matches->assign(base_size, kUnmatched);
+    size_t base_i = 0, other_i = 0;
+    for (size_t i = 0; i < edits.size(); ++i) {
+        if (edits[i] == kMatch) (*matches)[base_i] = other_i;
+        base_i += edits[i] != kAdd;
+        other_i += edits[i] != kRemove;
+    }
+}
+
+// Returns whether ids[begin, end) and base[base_begin, base_end) are the
+// same lines.
+bool SameLines(const std::vector<size_t> &ids, size_t begin, size_t end,
+               const std::vector<size_t> &base, size_t base_begin,
+               size_t base_end) {
+    return end - begin == base_end - base_begin &&
+           std::equal(ids.begin() + begin, ids.begin() + end,
+                      base.begin() + base_begin);
+}
+
+// The walk of Merge3 over the ids of the three sides and the matches of
+// the base lines in ours and theirs. A base line matched on both sides at
+// the current position of each is stable; the runs of stable lines are
+// kUnchanged regions, and each stretch between them is one region, of the
+// side that changed it, or kBoth or kConflict when both did.
+std::vector<MergeRegion> WalkMerge(const std::vector<size_t> &base,
+                                   const std::vector<size_t> &ours,
+                                   const std::vector<size_t> &theirs,
+                                   const std::vector<size_t> &ours_matches,
+                                   const std::vector<size_t> &theirs_matches) {
+    std::vector<MergeRegion> regions;
+    size_t base_i = 0, ours_i = 0, theirs_i = 0;
+    for (;;) {
+        MergeRegion region;
+        region.base_begin = base_i;
+        region.ours_begin = ours_i;
+        region.theirs_begin = theirs_i;
+        while (base_i < base.size() && ours_matches[base_i] == ours_i &&
+               theirs_matches[base_i] == theirs_i) {
+            ++base_i, ++ours_i, ++theirs_i;
+        }
+        if (base_i > region.base_begin) {
+            region.kind = MergeRegion::kUnchanged;
+            region.base_end = base_i;
+            region.ours_end = ours_i;
+            region.theirs_end = theirs_i;
+            regions.push_back(region);
+            region.base_begin = base_i;
+            region.ours_begin = ours_i;
+            region.theirs_begin = theirs_i;
+        }
+
+        // The next base line that both sides match ends the stretch; by
+        // then the matches are past the current positions, as they only
+        // increase.
+        while (base_i < base.size() && (ours_matches[base_i] == kUnmatched ||
+                                        theirs_matches[base_i] == kUnmatched)) {
+            ++base_i;
+        }
+        if (base_i < base.size()) {
+            ours_i = ours_matches[base_i];
+            theirs_i = theirs_matches[base_i];
+        } else {
+            ours_i = ours.size();
+            theirs_i = theirs.size();
+        }
+        region.base_end = base_i;
+        region.ours_end = ours_i;
+        region.theirs_end = theirs_i;
+        if (region.base_begin == base_i && region.ours_begin == ours_i &&
+            region.theirs_begin == theirs_i) {
+            // Only at the end of the three sides.
+            break;
+        }
+
+        if (SameLines(ours, region.ours_begin, ours_i, base,
+                      region.base_begin, base_i)) {
+            region.kind = MergeRegion::kTheirs;
+        } else if (SameLines(theirs, region.theirs_begin, theirs_i, base,
+                             region.base_begin, base_i)) {
+            region.kind = MergeRegion::kOurs;
+        } else if (SameLines(theirs, region.theirs_begin, theirs_i, ours,
+                             region.ours_begin, ours_i)) {
+            region.kind = MergeRegion::kBoth;
+        } else {
+            region.kind = MergeRegion::kConflict;
+        }
+        regions.push_back(region);
+    }
+    return regions;
+}
+
+template <typename Line>
+std::vector<MergeRegion> Merge3Of(const std::vector<Line> &base,
+                                  const std::vector<Line> &ours,
+                                  const std::vector<Line> &theirs,
+                                  const DiffOptions &options) {
+    // One intern table for the three sides, so that equal lines of ours and
+    // theirs have equal ids too and the walk compares no strings.
+    std::vector<size_t> base_ids(base.size()), ours_ids(ours.size()),
+        theirs_ids(theirs.size());
+    {
+        Workspace::Buffers *buffers = GetBuffers(options.workspace);
+        InternalStrings<Line> intern_table(base, ours, &buffers->slots,
+                                           &buffers->positions, &theirs);
+        size_t position = 0;
+        for (size_t i = 0; i < base.size(); ++i) {
+            base_ids[i] = intern_table.GetId(position++);
+        }
+        for (size_t i = 0; i < ours.size(); ++i) {
+            ours_ids[i] = intern_table.GetId(position++);
+        }
+        for (size_t i = 0; i < theirs.size(); ++i) {
+            theirs_ids[i] = intern_table.GetId(position++);
+        }
+    }
+
+    std::vector<EditType> edits;
+    std::vector<size_t> ours_matches, theirs_matches;
+    CalculateOptimalEdits(base_ids, ours_ids, options, &edits);
+    MatchBaseLines(edits, base.size(), &ours_matches);
+    CalculateOptimalEdits(base_ids, theirs_ids, options, &edits);
+    MatchBaseLines(edits, base.size(), &theirs_matches);
+    return WalkMerge(base_ids, ours_ids, theirs_ids, ours_matches,
+                     theirs_matches);
+}
+
+std::vector<MergeRegion> Merge3(const std::vector<std::string> &base,
+                                const std::vector<std::string> &ours,
+                                const std::vector<std::string> &theirs,
+                                const DiffOptions &options) {
+    return Merge3Of(base, ours, theirs, options);
+}
+
+std::vector<MergeRegion> Merge3(const std::vector<std::string_view> &base,
+                                const std::vector<std::string_view> &ours,
+                                const std::vector<std::string_view> &theirs,
+                                const DiffOptions &options) {
+    return Merge3Of(base, ours, theirs, options);
+}
+
+// Appends lines[begin, end) to 'out', each followed by '\n'.
+template <typename Line>
+void AppendLines(const std::vector<Line> &lines, size_t begin, size_t end,
+                 OutputBuffer *out) {
+    for (size_t i = begin; i < end; ++i) {
+        out->Append(std::string_view(lines[i]));
+        out->Append('\n');
+    }
+}
+
+template <typename Line>
+size_t WriteMerge3Of(const std::vector<Line> &base,
+                     const std::vector<Line> &ours,
+                     const std::vector<Line> &theirs,
+                     const std::vector<MergeRegion> &regions,
+                     const DiffWriter &write) {
+    OutputBuffer out(write);
+    size_t conflicts = 0;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        const MergeRegion &region = regions[i];
+        switch (region.kind) {
+            case MergeRegion::kUnchanged:
+                AppendLines(base, region.base_begin, region.base_end, &out);
+                break;
+            case MergeRegion::kOurs:
+            case MergeRegion::kBoth:
+                AppendLines(ours, region.ours_begin, region.ours_end, &out);
+                break;
+            case MergeRegion::kTheirs:
+                AppendLines(theirs, region.theirs_begin, region.theirs_end,
+                            &out);
+                break;
+            case MergeRegion::kConflict:
+                ++conflicts;
+                out.Append("<<<<<<< ours\n");
+                AppendLines(ours, region.ours_begin, region.ours_end, &out);
+                out.Append("||||||| base\n");
+                AppendLines(base, region.base_begin, region.base_end, &out);
+                out.Append("=======\n");
+                AppendLines(theirs, region.theirs_begin, region.theirs_end,
+                            &out);
+                out.Append(">>>>>>> theirs\n");
+                break;
+        }
+    }
+    return conflicts;
+}
+
+size_t WriteMerge3(const std::vector<std::string> &base,
+                   const std::vector<std::string> &ours,
+                   const std::vector<std::string> &theirs,
+                   const std::vector<MergeRegion> &regions,
+                   const DiffWriter &write) {
+    return WriteMerge3Of(base, ours, theirs, regions, write);
+}
+
+size_t WriteMerge3(const std::vector<std::string_view> &base,
+                   const std::vector<std::string_view> &ours,
+                   const std::vector<std::string_view> &theirs,
+                   const std::vector<MergeRegion> &regions,
+                   const DiffWriter &write) {
+    return WriteMerge3Of(base, ours, theirs, regions, write);
+}
+
+// Appends to 'lines' the lines of data[0, size), without their '\n'. The
+// last line is kept even without a '\n'.
+void IndexLines(const char *data, size_t size,
+                std::vector<std::string_view> *lines) {
+    size_t start = 0;
+    while (start < size) {
+        const char *end = static_cast<const char *>(
+            std::memchr(data + start, '\n', size - start));
+        const size_t line_end = end ? end - data : size;
+        lines->push_back(std::string_view(data + start, line_end - start));
+        start = line_end + 1;
+    }
+}
+
+#if EDIT_DISTANCE_USE_AVX2
+// Same as IndexLines, 32 bytes at a time: each newline is a bit of the mask
+// of a byte compare, so short lines do not pay for a memchr call each.
+EDIT_DISTANCE_AVX2
+void IndexLinesAvx2(const char *data, size_t size,
+                    std::vector<std::string_view> *lines) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t start = 0, i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i bytes = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(data + i));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline));
+        while (mask) {
+            const size_t end = i + __builtin_ctz(mask);
+            lines->push_back(std::string_view(data + start, end - start));
+            start = end + 1;
+            mask &= mask - 1;
+        }
+    }
+    IndexLines(data + start, size - start, lines);
+}
+#endif  // EDIT_DISTANCE_USE_AVX2
+
+MappedFile::MappedFile()
+    : mapping_(NULL), mapping_size_(0), data_(NULL), size_(0) {}
+
+MappedFile::~MappedFile() { Close(); }
+
+void MappedFile::Close() {
+    if (mapping_) munmap(mapping_, mapping_size_);
+    mapping_ = NULL;
+    mapping_size_ = 0;
+    std::string().swap(buffer_);
+    data_ = NULL;
+    size_ = 0;
+}
+
+// Reads all of 'fd' into 'buffer'. Returns false, with errno set, on a read
+// error.
+bool ReadAll(int fd, std::string *buffer) {
+    char block[1 << 16];
+    for (;;) {
+        const ssize_t size = read(fd, block, sizeof(block));
+        if (size == 0) return true;
+        if (size < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buffer->append(block, size);
+    }
+}
+
+bool MappedFile::Open(const char *path) {
+    Close();
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        // A pipe reports a size of 0 whatever it holds, and cannot be
+        // mapped anyway. So do the files of /proc, which are regular; an
+        // empty file just reads as nothing.
+        if (!ReadAll(fd, &buffer_)) {
+            const int error = errno;
+            close(fd);
+            errno = error;
+            return false;
+        }
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    } else {
+        mapping_size_ = st.st_size;
+        mapping_ = mmap(NULL, mapping_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping_ == MAP_FAILED) {
+            const int error = errno;
+            mapping_ = NULL;
+            mapping_size_ = 0;
+            close(fd);
+            errno = error;
+            return false;
+        }
+        data_ = static_cast<const char *>(mapping_);
+        size_ = mapping_size_;
+    }
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+    return true;
+}
+
+bool MappedLines::Open(const char *path) {
+    lines_.clear();
+    if (!file_.Open(path)) return false;
+    const char *data = file_.data().data();
+    const size_t size = file_.data().size();
+
+    // One more pass over the data sizes the index exactly, instead of
+    // leaving up to half of it unused after the last doubling.
+    lines_.reserve(std::count(data, data + size, '\n') +
+                   (size > 0 && data[size - 1] != '\n'));
+#if EDIT_DISTANCE_USE_AVX2
+    if (CpuHasAvx2()) {
+        IndexLinesAvx2(data, size, &lines_);
+        return true;
+    }
+#endif
+    IndexLines(data, size, &lines_);
+    return true;
+}
+
+bool WriteFileDiff(const char *left_path, const char *right_path,
+                   const DiffOptions &options, const DiffWriter &write) {
+    MappedLines left, right;
+    if (!left.Open(left_path) || !right.Open(right_path)) return false;
+    WriteUnifiedDiff(left.lines(), right.lines(), options, write);
+    return true;
+}
+}  // namespace edit_distance
@@ -0,0 +1,446 @@
+/* Copied from google-test
+ */
+
+#ifndef EDIT_DISTANCE_H
+#define EDIT_DISTANCE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace edit_distance {
+// Returns the optimal edits to go from 'left' to 'right'.
+// All edits cost the same, with replace having lower priority than
+// add/remove.
+// Simple implementation of the Wagner-Fischer algorithm.
+// See http://en.wikipedia.org/wiki/Wagner-Fischer_algorithm
+// kTranspose, two adjacent elements swapped, is only emitted by
+// CalculateTranspositionEdits.
+enum EditType { kMatch, kAdd, kRemove, kReplace, kTranspose };
+
+// The algorithm used to compute the edit script.
+enum Algorithm {
+    // The Wagner-Fischer DP described above. O(N*M) time and memory. This is
+    // the reference implementation.
+    kWagnerFischer,
+    // Myers' O((N+M)*D) greedy algorithm, in its linear space divide and
+    // conquer form. D is the number of added/removed elements, so this is
+    // fast on near-identical inputs. It finds a shortest script of adds and
+    // removes only and never emits kReplace.
+    // See http://www.xmailserver.org/diff2.pdf
+    kMyers,
+    // Hirschberg style divide and conquer over the Wagner-Fischer DP. Same
+    // edit script as kWagnerFischer in near-linear memory, at about 3x the
+    // time.
+    kLinearSpace,
+    // kWagnerFischer split into tiles that all hardware threads compute one
+    // anti-diagonal of tiles at a time, each tile with the vector kernel
+    // when the CPU has one. Same edit script. Uses no more threads than
+    // the longest anti-diagonal has tiles, and runs the serial DP below
+    // about a million cells.
+    kParallel,
+    // Patience diff, as in git: matches the elements that occur exactly once
+    // on each side, in order, and recurses between them. Hunks follow
+    // unique lines such as function headers instead of blank lines and
+    // braces, which usually reads better. Like kMyers, no kReplace, and the
+    // script is not always the shortest.
+    kPatience,
+    // Histogram diff, as in git: like kPatience, but splits at the longest
+    // common run around the least frequent elements, so it also works when
+    // few elements are unique.
+    kHistogram,
+    // A merge of the two sides as sorted lists, as in comm: O(N+M). The
+    // common elements are matched in order and the others are removes and
+    // adds. When both sides are sorted, lines in byte order (sort with
+    // LC_ALL=C) and ids by value, that is a shortest script of adds and
+    // removes; like kMyers, it has no kReplace. DiffOptions::reduce is
+    // ignored, there is nothing to gain. See DiffOptions::check_sorted.
+    kSorted
+};
+
+class Workspace;
+
+// Second pass of the unified diff over changed lines, see
+// DiffOptions::intraline.
+enum Intraline {
+    kNoIntraline,
+    // Marks the changed bytes.
+    kIntralineChars,
+    // Marks the changed words: runs of letters, digits and '_', and each
+    // other byte on its own.
+    kIntralineWords
+};
+
+// Options of the diff entry points.
+struct DiffOptions {
+    DiffOptions()
+        : algorithm(kWagnerFischer),
+          context(2),
+          reduce(false),
+          intraline(kNoIntraline),
+          workspace(NULL),
+          check_sorted(true) {}
+
+    Algorithm algorithm;
+    // Unchanged lines kept around the changes by CreateUnifiedDiff.
+    size_t context;
+    // Strips the common prefix and suffix and drops the elements that the
+    // other side does not have at all, splices those back in as matches,
+    // removes and adds, and runs 'algorithm' only between anchors: elements
+    // that occur once on each side, in the same order. When a few places
+    // differ this shrinks the problem by orders of magnitude. The script may
+    // differ from the reference, e.g. a dropped pair is a remove and an add
+    // instead of a kReplace, or an anchor is matched where a longer run of
+    // repeated elements could have been.
+    bool reduce;
+    // Marks what changed inside the lines of the unified diff. Where a run
+    // of removed lines is followed by as many added lines, e.g. kReplace
+    // edits, each pair of lines is diffed again by characters or words,
+    // and the removed parts are wrapped in "[-" "-]" on the '-' line and
+    // the added parts in "{+" "+}" on the '+' line. That diff is banded and
+    // gives up beyond a few edits per line, marking everything between the
+    // common start and end of the pair, so the cost stays linear in the
+    // size of the output.
+    Intraline intraline;
+    // The scratch memory of the Wagner-Fischer DP and of the line ids, NULL
+    // for the calling thread's own Workspace.
+    Workspace *workspace;
+    // With kSorted, checks that both sides are sorted first, in O(N+M), and
+    // runs kMyers instead when one is not. Without the check, unsorted
+    // sides still get a valid script, but it can be far from the shortest.
+    bool check_sorted;
+};
+
+// Scratch memory that the edit script and distance functions reuse from
+// one call to the next: the rows and traceback of the Wagner-Fischer DP,
+// the line ids and their intern table, and the bit vectors of Distance. The
+// buffers only grow, so once they fit the inputs, the scalar
+// Wagner-Fischer DP (below a few thousand cells), the interning and
+// Distance allocate nothing, and neither do the functions that write their
+// script to a caller's vector. The other algorithms, the vector kernel and
+// 'reduce' still allocate their own memory.
+// Every thread has its own Workspace, used when none is given. A Workspace
+// must not be used by two threads at once.
+class Workspace {
+   public:
+    Workspace();
+    ~Workspace();
+
+    // Frees the buffers.
+    void Clear();
+
+    struct Buffers;
+
+   private:
+    Workspace(const Workspace &);
+    Workspace &operator=(const Workspace &);
+
+    friend Buffers *GetBuffers(Workspace *workspace);
+
+    Buffers *buffers_;
+};
+
+// See cost_policy.h for the same DP with other costs.
+std::vector<EditType> CalculateOptimalEdits(
+    const std::vector<size_t> &left, const std::vector<size_t> &right,
+    Algorithm algorithm = kWagnerFischer);
+
+// Same as above, but the input is represented as strings.
+std::vector<EditType> CalculateOptimalEdits(
+    const std::vector<std::string> &left,
+    const std::vector<std::string> &right,
+    Algorithm algorithm = kWagnerFischer);
+
+// Same as above, for lines that live elsewhere. No line is copied.
+std::vector<EditType> CalculateOptimalEdits(
+    const std::vector<std::string_view> &left,
+    const std::vector<std::string_view> &right,
+    Algorithm algorithm = kWagnerFischer);
+
+// Same as the three above, with all the options.
+std::vector<EditType> CalculateOptimalEdits(const std::vector<size_t> &left,
+                                            const std::vector<size_t> &right,
+                                            const DiffOptions &options);
+std::vector<EditType> CalculateOptimalEdits(
+    const std::vector<std::string> &left,
+    const std::vector<std::string> &right, const DiffOptions &options);
+std::vector<EditType> CalculateOptimalEdits(
+    const std::vector<std::string_view> &left,
+    const std::vector<std::string_view> &right, const DiffOptions &options);
+
+// Same as the three above, writing the script to 'edits' so that its memory
+// is reused too (see Workspace).
+void CalculateOptimalEdits(const std::vector<size_t> &left,
+                           const std::vector<size_t> &right,
+                           const DiffOptions &options,
+                           std::vector<EditType> *edits);
+void CalculateOptimalEdits(const std::vector<std::string> &left,
+                           const std::vector<std::string> &right,
+                           const DiffOptions &options,
+                           std::vector<EditType> *edits);
+void CalculateOptimalEdits(const std::vector<std::string_view> &left,
+                           const std::vector<std::string_view> &right,
+                           const DiffOptions &options,
+                           std::vector<EditType> *edits);
+
+// 'count' edits of the same type in a row.
+struct EditRun {
+    EditRun() : type(kMatch), count(0) {}
+    EditRun(EditType type, size_t count) : type(type), count(count) {}
+
+    EditType type;
+    size_t count;
+};
+
+// The script of CalculateOptimalEdits as runs, two runs in a row never of
+// the same type. The runs are built as the script is, so when few places
+// differ they take a few words instead of one per element: a 2M line file
+// with a handful of changes is a dozen runs.
+void CalculateEditRuns(const std::vector<size_t> &left,
+                       const std::vector<size_t> &right,
+                       const DiffOptions &options, std::vector<EditRun> *runs);
+void CalculateEditRuns(const std::vector<std::string> &left,
+                       const std::vector<std::string> &right,
+                       const DiffOptions &options, std::vector<EditRun> *runs);
+void CalculateEditRuns(const std::vector<std::string_view> &left,
+                       const std::vector<std::string_view> &right,
+                       const DiffOptions &options, std::vector<EditRun> *runs);
+
+// The number of edits of each type in a script.
+struct EditCounts {
+    EditCounts()
+        : matches(0), adds(0), removes(0), replaces(0), transposes(0) {}
+
+    size_t matches, adds, removes, replaces, transposes;
+};
+
+// Counts the edits of 'runs' in O(runs).
+EditCounts CountEdits(const std::vector<EditRun> &runs);
+// Same as above, in O(edits).
+EditCounts CountEdits(const std::vector<EditType> &edits);
+
+// Same as CalculateOptimalEdits with kParallel, using 'threads' threads.
+std::vector<EditType> CalculateParallelEdits(const std::vector<size_t> &left,
+                                             const std::vector<size_t> &right,
+                                             size_t threads);
+
+// Returns the Levenshtein distance between 'left' and 'right', the minimal
+// number of adds, removes and replaces, without building an edit script.
+// Uses the bit-parallel algorithm of Myers/Hyyrö: O(N * M / 64) word
+// operations. The script of CalculateOptimalEdits is not always minimal (see
+// the tie rule in ChooseMove), so this can be lower than its edit count.
+// The bit vectors live in 'workspace', NULL for the thread's own.
+size_t Distance(std::string_view left, std::string_view right,
+                Workspace *workspace = NULL);
+
+// Same as above, but the input is represented as ids.
+size_t Distance(const std::vector<size_t> &left,
+                const std::vector<size_t> &right,
+                Workspace *workspace = NULL);
+
+// Returns the optimal string alignment distance between 'left' and 'right':
+// like Distance, but swapping two adjacent elements counts as one edit (a
+// restricted Damerau-Levenshtein distance, where no element is edited again
+// after a swap). Same bit-parallel algorithm, a few more operations per
+// word.
+size_t TranspositionDistance(std::string_view left, std::string_view right,
+                             Workspace *workspace = NULL);
+
+// Same as above, but the input is represented as ids.
+size_t TranspositionDistance(const std::vector<size_t> &left,
+                             const std::vector<size_t> &right,
+                             Workspace *workspace = NULL);
+
+// Returns a shortest edit script from 'left' to 'right' in the model of
+// TranspositionDistance: kTranspose stands for the two elements
+// left[l_i, l_i + 2) matching right[r_i + 1] and right[r_i]. Its number of
+// edits other than kMatch is the distance. O(N*M) time and memory.
+std::vector<EditType> CalculateTranspositionEdits(
+    const std::vector<size_t> &left, const std::vector<size_t> &right);
+
+// Same as above, for the characters of two strings.
+std::vector<EditType> CalculateTranspositionEdits(std::string_view left,
+                                                  std::string_view right);
+
+// Like CalculateOptimalEdits with kWagnerFischer, but only for scripts of at
+// most 'max_edits' adds, removes and replaces. Only the diagonal band
+// |l_i - r_i| <= max_edits of the DP is computed, O((N+M) * max_edits), and
+// the DP stops as soon as a whole row of the band exceeds the bound.
+// Returns false, leaving 'edits' untouched, when the bound is exceeded.
+bool CalculateBoundedEdits(const std::vector<size_t> &left,
+                           const std::vector<size_t> &right, size_t max_edits,
+                           std::vector<EditType> *edits);
+
+// Same as above, but the input is represented as strings. The line ids live
+// in 'workspace', NULL for the thread's own.
+bool CalculateBoundedEdits(const std::vector<std::string> &left,
+                           const std::vector<std::string> &right,
+                           size_t max_edits, std::vector<EditType> *edits,
+                           Workspace *workspace = NULL);
+
+// Returns Distance(left, right) if it is at most 'max_distance', and
+// max_distance + 1 otherwise. Banded like CalculateBoundedEdits, so it is
+// linear in the input size for a small bound.
+size_t BoundedDistance(std::string_view left, std::string_view right,
+                       size_t max_distance);
+
+// Same as above, but the input is represented as ids.
+size_t BoundedDistance(const std::vector<size_t> &left,
+                       const std::vector<size_t> &right, size_t max_distance);
+
+// Create a diff of the input strings in Unified diff format.
+std::string CreateUnifiedDiff(const std::vector<std::string> &left,
+                              const std::vector<std::string> &right,
+                              size_t context = 2,
+                              Algorithm algorithm = kWagnerFischer);
+
+// Same as above, with all the options.
+std::string CreateUnifiedDiff(const std::vector<std::string> &left,
+                              const std::vector<std::string> &right,
+                              const DiffOptions &options);
+
+// Receives the output of WriteUnifiedDiff, in consecutive pieces.
+typedef std::function<void(std::string_view)> DiffWriter;
+
+// Same as CreateUnifiedDiff, but hands the output to 'write' in blocks of
+// a few KB as the hunks are done instead of building one string, so the
+// memory does not grow with the size of the diff.
+void WriteUnifiedDiff(const std::vector<std::string> &left,
+                      const std::vector<std::string> &right,
+                      const DiffOptions &options, const DiffWriter &write);
+void WriteUnifiedDiff(const std::vector<std::string_view> &left,
+                      const std::vector<std::string_view> &right,
+                      const DiffOptions &options, const DiffWriter &write);
+
+// Same as above, writing to 'os'.
+void WriteUnifiedDiff(const std::vector<std::string> &left,
+                      const std::vector<std::string> &right,
+                      const DiffOptions &options, std::ostream *os);
+void WriteUnifiedDiff(const std::vector<std::string_view> &left,
+                      const std::vector<std::string_view> &right,
+                      const DiffOptions &options, std::ostream *os);
+
+// Same as above, writing to 'file'.
+void WriteUnifiedDiff(const std::vector<std::string> &left,
+                      const std::vector<std::string> &right,
+                      const DiffOptions &options, FILE *file);
+void WriteUnifiedDiff(const std::vector<std::string_view> &left,
+                      const std::vector<std::string_view> &right,
+                      const DiffOptions &options, FILE *file);
+
+// A run of the output of Merge3, as the lines [begin, end) of each input.
+struct MergeRegion {
+    enum Kind {
+        // The three inputs have the same lines.
+        kUnchanged,
+        // Only ours changed the base lines; the output takes ours.
+        kOurs,
+        // Only theirs changed them; the output takes theirs.
+        kTheirs,
+        // Both changed them to the same lines; the output takes ours.
+        kBoth,
+        // Both changed them, differently.
+        kConflict
+    };
+
+    Kind kind;
+    size_t base_begin, base_end;
+    size_t ours_begin, ours_end;
+    size_t theirs_begin, theirs_end;
+};
+
+// Three-way merge of the changes from 'base' to 'ours' and from 'base' to
+// 'theirs', as in diff3 and git. The lines of the three inputs go through
+// one intern table, the two edit scripts are computed on the ids with the
+// algorithm, reduction and workspace of 'options', and a walk of both
+// scripts in lock-step, linear in the number of lines, splits the output
+// into regions: a run of base lines that both sides keep is kUnchanged, and
+// the lines between two such runs are taken from the side that changed
+// them, or are a conflict. The regions point into the inputs and no line
+// is copied.
+std::vector<MergeRegion> Merge3(const std::vector<std::string> &base,
+                                const std::vector<std::string> &ours,
+                                const std::vector<std::string> &theirs,
+                                const DiffOptions &options = DiffOptions());
+std::vector<MergeRegion> Merge3(const std::vector<std::string_view> &base,
+                                const std::vector<std::string_view> &ours,
+                                const std::vector<std::string_view> &theirs,
+                                const DiffOptions &options = DiffOptions());
+
+// Writes the merged lines of 'regions', from Merge3 of the same inputs,
+// each followed by '\n'. A conflict is written in the diff3 style of git:
+// "<<<<<<< ours", the lines of ours, "||||||| base", the lines of base,
+// "=======", the lines of theirs and ">>>>>>> theirs". Returns the number
+// of conflicts.
+size_t WriteMerge3(const std::vector<std::string> &base,
+                   const std::vector<std::string> &ours,
+                   const std::vector<std::string> &theirs,
+                   const std::vector<MergeRegion> &regions,
+                   const DiffWriter &write);
+size_t WriteMerge3(const std::vector<std::string_view> &base,
+                   const std::vector<std::string_view> &ours,
+                   const std::vector<std::string_view> &theirs,
+                   const std::vector<MergeRegion> &regions,
+                   const DiffWriter &write);
+
+// A file mapped read-only in memory. Pipes, FIFOs and other files that are
+// not regular cannot be mapped and are read into memory instead, like the
+// regular files that report a size of 0, such as those of /proc.
+class MappedFile {
+   public:
+    MappedFile();
+    ~MappedFile();
+
+    // Maps the file at 'path'. Returns false, with errno set, when the file
+    // cannot be opened, mapped or read.
+    bool Open(const char *path);
+
+    // The content of the file.
+    std::string_view data() const { return std::string_view(data_, size_); }
+
+   private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    void Close();
+
+    void *mapping_;
+    size_t mapping_size_;
+    // The content of a file that is read instead of mapped.
+    std::string buffer_;
+    const char *data_;
+    size_t size_;
+};
+
+// The lines of a file mapped read-only in memory. The lines point into the
+// mapping, without their '\n', and are found with an AVX2 scan when the CPU
+// supports it. Nothing is copied, so the memory used besides the mapping
+// (which the kernel can drop and page in again) is one string_view per
+// line. Files that cannot be mapped are read as in MappedFile.
+class MappedLines {
+   public:
+    // Maps the file at 'path' and indexes its lines. Returns false, with
+    // errno set, when the file cannot be opened, mapped or read.
+    bool Open(const char *path);
+
+    const std::vector<std::string_view> &lines() const { return lines_; }
+
+   private:
+    MappedFile file_;
+    std::vector<std::string_view> lines_;
+};
+
+// Same as WriteUnifiedDiff, for the files at 'left_path' and 'right_path'
+// read through MappedLines. Returns false, with errno set, when a file
+// cannot be read.
+bool WriteFileDiff(const char *left_path, const char *right_path,
+                   const DiffOptions &options, const DiffWriter &write);
+
+}  // namespace edit_distance
+
+#endif  // EDIT_DISTANCE_H
@@ -0,0 +1,161 @@
+/* Unified diff of two files, without reading them into memory.
+ *
+ * Usage: fdiff [-U context] [-a algorithm] [-m marks] [-R] [-c store]
+ *              left right
+ *
+ * With -c, the diff is looked up in and added to the DiffCache store at
+ * 'store', so that diffing the same files again, from any process, reads
+ * the diff back instead of computing it. The diff is then built in memory.
+ *
+ * Exits with 0 when the files have the same lines, 1 when they differ and 2
+ * on errors, like diff.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+
+#include "diff_cache.h"
+#include "edit_distance.h"
+
+static const struct {
+    const char *name;
+    edit_distance::Algorithm algorithm;
+} kAlgorithms[] = {
+    {"wagner-fischer", edit_distance::kWagnerFischer},
+    {"myers", edit_distance::kMyers},
+    {"linear-space", edit_distance::kLinearSpace},
+    {"parallel", edit_distance::kParallel},
+    {"patience", edit_distance::kPatience},
+    {"histogram", edit_distance::kHistogram},
+    {"sorted", edit_distance::kSorted},
+};
+
+static void usage(const char *program) {
+    size_t i;
+
+    fprintf(stderr,
+            "Usage: %s [-U context] [-a algorithm] [-m marks] [-R] "
+            "[-c store] left right\n"
+            "  -U  unchanged lines around the changes (default 3)\n"
+            "  -a  algorithm (default myers):",
+            program);
+    for (i = 0; i < sizeof(kAlgorithms) / sizeof(kAlgorithms[0]); ++i) {
+        fprintf(stderr, " %s", kAlgorithms[i].name);
+    }
+    fprintf(stderr,
+            "\n"
+            "  -m  mark the changes inside the lines: chars or words\n"
+            "  -R  do not strip the common and unique lines first; the\n"
+            "      algorithm then runs on whole files\n"
+            "  -c  cache the diff in the file 'store'\n");
+}
+
+int main(int argc, char *argv[]) {
+    edit_distance::DiffOptions options;
+    options.algorithm = edit_distance::kMyers;
+    options.context = 3;
+    options.reduce = true;
+    const char *store = NULL;
+
+    int opt;
+    size_t i;
+    while ((opt = getopt(argc, argv, "U:a:m:Rc:")) != -1) {
+        switch (opt) {
+            case 'U': {
+                char *end;
+                errno = 0;
+                options.context = strtoul(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || errno != 0 ||
+                    *optarg == '-') {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            }
+            case 'a':
+                for (i = 0; i < sizeof(kAlgorithms) / sizeof(kAlgorithms[0]);
+                     ++i) {
+                    if (strcmp(optarg, kAlgorithms[i].name) == 0) break;
+                }
+                if (i == sizeof(kAlgorithms) / sizeof(kAlgorithms[0])) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                options.algorithm = kAlgorithms[i].algorithm;
+                break;
+            case 'm':
+                if (strcmp(optarg, "chars") == 0) {
+                    options.intraline = edit_distance::kIntralineChars;
+                } else if (strcmp(optarg, "words") == 0) {
+                    options.intraline = edit_distance::kIntralineWords;
+                } else {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'R':
+                options.reduce = false;
+                break;
+            case 'c':
+                store = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *left = argv[optind], *right = argv[optind + 1];
+
+    if (store) {
+        edit_distance::MappedLines left_lines, right_lines;
+        if (!left_lines.Open(left) || !right_lines.Open(right)) {
+            fprintf(stderr, "%s: cannot read %s and %s: %s\n", argv[0], left,
+                    right, strerror(errno));
+            return 2;
+        }
+        // One diff per run: the memory part of the cache only has to hold
+        // it until it is written.
+        edit_distance::DiffCache cache(static_cast<size_t>(-1));
+        if (!cache.OpenStore(store)) {
+            fprintf(stderr, "%s: cannot open %s: %s\n", argv[0], store,
+                    strerror(errno));
+            return 2;
+        }
+        const std::string diff = cache.CreateUnifiedDiff(
+            left_lines.lines(), right_lines.lines(), options);
+        if (!diff.empty()) {
+            printf("--- %s\n+++ %s\n", left, right);
+            fwrite(diff.data(), 1, diff.size(), stdout);
+        }
+        if (fflush(stdout) != 0) return 2;
+        return diff.empty() ? 0 : 1;
+    }
+
+    // The file header goes out with the first hunk, if any.
+    bool differ = false;
+    const bool ok = edit_distance::WriteFileDiff(
+        left, right, options, [&](std::string_view block) {
+            if (!differ) {
+                printf("--- %s\n+++ %s\n", left, right);
+                differ = true;
+            }
+            fwrite(block.data(), 1, block.size(), stdout);
+        });
+    if (!ok) {
+        fprintf(stderr, "%s: cannot read %s and %s: %s\n", argv[0], left,
+                right, strerror(errno));
+        return 2;
+    }
+    if (fflush(stdout) != 0) return 2;
+    return differ ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+/* Applies a unified diff of fdiff or CreateUnifiedDiff to a file, without
+ * reading either into memory.
+ *
+ * Usage: fpatch [-w window] [-o output] file patch
+ *
+ * The result goes to 'output', or to stdout, in one pass of gather writes
+ * over the mapped file and patch. 'output' is written to a temporary file
+ * next to it that is renamed over it at the end, so it may be 'file' and is
+ * never left half written. Exits with 0 when the patch applies, 1 when a
+ * hunk does not and 2 on errors.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "edit_distance.h"
+#include "patch.h"
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-w window] [-o output] file patch\n"
+            "  -w  lines a hunk may move from where the patch puts it\n"
+            "      (default 100)\n"
+            "  -o  output file (default stdout)\n",
+            program);
+}
+
+int main(int argc, char *argv[]) {
+    size_t window = 100;
+    const char *output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:o:")) != -1) {
+        switch (opt) {
+            case 'w': {
+                char *end;
+                errno = 0;
+                window = strtoul(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || errno != 0 ||
+                    *optarg == '-') {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            }
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    edit_distance::MappedFile original, text;
+    for (int i = 0; i < 2; ++i) {
+        const char *path = argv[optind + i];
+        if (!(i == 0 ? original : text).Open(path)) {
+            fprintf(stderr, "%s: cannot read %s: %s\n", argv[0], path,
+                    strerror(errno));
+            return 2;
+        }
+    }
+
+    edit_distance::Patch patch;
+    size_t error_line;
+    if (!edit_distance::ParsePatch(text.data(), &patch, &error_line)) {
+        fprintf(stderr, "%s: %s:%zu: malformed patch\n", argv[0],
+                argv[optind + 1], error_line);
+        return 2;
+    }
+    std::vector<std::string_view> pieces;
+    size_t failed_hunk;
+    if (!edit_distance::ApplyPatch(original.data(), patch, window, &pieces,
+                                   &failed_hunk)) {
+        fprintf(stderr, "%s: hunk %zu of %s does not apply\n", argv[0],
+                failed_hunk + 1, argv[optind + 1]);
+        return 1;
+    }
+
+    if (!output) {
+        if (!edit_distance::WritePieces(STDOUT_FILENO, pieces)) {
+            fprintf(stderr, "%s: cannot write the output: %s\n", argv[0],
+                    strerror(errno));
+            return 2;
+        }
+        return 0;
+    }
+
+    // The temporary file takes the mode of the file it replaces, or the one
+    // open would give a new file.
+    struct stat st;
+    mode_t mode;
+    if (stat(output, &st) == 0) {
+        mode = st.st_mode & 07777;
+    } else {
+        const mode_t mask = umask(0);
+        umask(mask);
+        mode = 0666 & ~mask;
+    }
+    std::string temporary = std::string(output) + ".XXXXXX";
+    const int fd = mkstemp(&temporary[0]);
+    if (fd < 0) {
+        fprintf(stderr, "%s: cannot create %s: %s\n", argv[0],
+                temporary.c_str(), strerror(errno));
+        return 2;
+    }
+    const bool written = fchmod(fd, mode) == 0 &&
+                         edit_distance::WritePieces(fd, pieces);
+    const int saved_errno = errno;
+    if (close(fd) != 0 || !written ||
+        rename(temporary.c_str(), output) != 0) {
+        if (!written) errno = saved_errno;
+        fprintf(stderr, "%s: cannot write %s: %s\n", argv[0], output,
+                strerror(errno));
+        unlink(temporary.c_str());
+        return 2;
+    }
+    return 0;
+}
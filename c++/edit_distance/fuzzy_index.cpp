@@ -0,0 +1,281 @@
+#include "fuzzy_index.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace edit_distance {
+// Cap of the lengths in FuzzyIndex::Edge, which means "or more".
+const unsigned kLengthCap = 255;
+
+FuzzyIndex::FuzzyIndex(const std::vector<std::string> &words)
+    : longest_entry_(0) {
+    // Equal entries end up next to each other, the first occurrence first.
+    std::vector<uint32_t> order(words.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&words](uint32_t a, uint32_t b) {
+                         return words[a] < words[b];
+                     });
+
+    // The entries order[lo, hi) share their first 'depth' bytes and are
+    // below the next node. The nodes are laid out depth first, so that a
+    // subtree is contiguous, and 'edge' is the edge of the parent to
+    // update with the node.
+    struct Range {
+        size_t lo, hi, depth, edge;
+    };
+    std::vector<Range> stack(1, Range{0, words.size(), 0, 0});
+    while (!stack.empty()) {
+        const Range range = stack.back();
+        stack.pop_back();
+        if (!nodes_.empty()) edges_[range.edge].child = nodes_.size();
+        Node node = {static_cast<uint32_t>(edges_.size()), 0};
+        size_t lo = range.lo;
+        while (lo < range.hi && words[order[lo]].size() == range.depth) {
+            if (node.word == 0) node.word = order[lo] + 1;
+            ++lo;
+        }
+        nodes_.push_back(node);
+        const size_t first_child = stack.size();
+        while (lo < range.hi) {
+            const unsigned char label = words[order[lo]][range.depth];
+            size_t hi = lo + 1;
+            while (hi < range.hi &&
+                   static_cast<unsigned char>(words[order[hi]][range.depth]) ==
+                       label) {
+                ++hi;
+            }
+            stack.push_back(Range{lo, hi, range.depth + 1, edges_.size()});
+            edges_.push_back(Edge{0, label, 0, 0});
+            lo = hi;
+        }
+        // The first child is visited next.
+        std::reverse(stack.begin() + first_child, stack.end());
+    }
+    nodes_.push_back(Node{static_cast<uint32_t>(edges_.size()), 0});
+    for (size_t i = 0; i < words.size(); ++i) {
+        longest_entry_ = std::max(longest_entry_, words[i].size());
+    }
+
+    // Children come after their parent, so one backward pass sees all the
+    // children of a node before the node. Each edge gets the lengths of its
+    // child, so that a lookup reads them with the labels.
+    std::vector<unsigned char> shortest(nodes_.size() - 1),
+        longest(nodes_.size() - 1);
+    for (size_t node = nodes_.size() - 1; node-- > 0;) {
+        unsigned node_shortest = nodes_[node].word != 0 ? 0 : kLengthCap;
+        unsigned node_longest = 0;
+        for (uint32_t edge = nodes_[node].first_edge;
+             edge < nodes_[node + 1].first_edge; ++edge) {
+            Edge &e = edges_[edge];
+            e.shortest = shortest[e.child];
+            e.longest = longest[e.child];
+            node_shortest = std::min(node_shortest, e.shortest + 1u);
+            node_longest = std::max(node_longest, e.longest + 1u);
+        }
+        shortest[node] = std::min(node_shortest, kLengthCap);
+        longest[node] = std::min(node_longest, kLengthCap);
+    }
+}
+
+// The state of one lookup: the DP rows of the current path and the best
+// matches so far.
+class FuzzyIndex::Search {
+   public:
+    Search(const FuzzyIndex &index, std::string_view query,
+           size_t max_distance, size_t limit)
+        : index_(index),
+          query_(query),
+          max_distance_(max_distance),
+          band_(),
+          bound_(),
+          limit_(limit),
+          width_(2 * max_distance + 1),
+          // No path is longer than the longest entry, and prefixes longer
+          // than query + max_distance are too far.
+          rows_((std::min(query.size() + max_distance,
+                          index.longest_entry_) +
+                 2) *
+                width_),
+          others_(rows_.size()) {
+        // Bit j of masks_[c] is set when query[j] is c.
+        if (query.size() <= 64) {
+            masks_.resize(256);
+            for (size_t j = 0; j < query.size(); ++j) {
+                masks_[static_cast<unsigned char>(query[j])] |= 1ULL << j;
+            }
+        }
+    }
+
+    // Searches with a growing bound, which stops at the first one that
+    // fills 'limit': a narrower band and a lower bound prune much more, so
+    // the passes before the last one cost little.
+    std::vector<Match> Run() {
+        if (limit_ == 0) return matches_;
+        for (size_t bound = 0; bound <= max_distance_; ++bound) {
+            band_ = bound_ = bound;
+            matches_.clear();
+            size_t *row = Row(&rows_, 0);
+            for (size_t j = 0; j <= std::min(query_.size(), band_); ++j) {
+                row[j] = j;
+            }
+            Visit(0, 0);
+            if (matches_.size() == limit_) break;
+        }
+        std::sort_heap(matches_.begin(), matches_.end(), Closer);
+        return matches_;
+    }
+
+   private:
+    static bool Closer(const Match &a, const Match &b) {
+        return a.distance != b.distance ? a.distance < b.distance
+                                        : a.id < b.id;
+    }
+
+    // The row of 'depth' in 'rows', indexed by query position j: only
+    // |depth - j| <= max_distance_ is stored.
+    size_t *Row(std::vector<size_t> *rows, size_t depth) const {
+        return rows->data() + depth * (width_ - 1) + max_distance_;
+    }
+
+    // Row(&rows_, depth) is the row of the path to 'node'.
+    void Visit(uint32_t node, size_t depth) {
+        const size_t *row = Row(&rows_, depth);
+        // row[query_.size()] is only computed within the band.
+        const Node &here = index_.nodes_[node];
+        if (here.word != 0 && query_.size() <= depth + band_ &&
+            row[query_.size()] <= bound_) {
+            Offer(here.word - 1, row[query_.size()]);
+        }
+        if (depth + 1 > query_.size() + band_) return;
+
+        // Only the cells with |depth - j| <= band_ can be within the bound.
+        const size_t lo = depth + 1 > band_ ? depth + 1 - band_ : 0;
+        const size_t hi = std::min(query_.size(), depth + 1 + band_);
+        // The next row is the same for all the bytes that are not in the
+        // band of the query, so it is computed once for them.
+        size_t *other = Row(&others_, depth + 1);
+        const size_t other_best = FillRow(row, depth, lo, hi, -1, other);
+        size_t *next = Row(&rows_, depth + 1);
+        const Edge *first = index_.edges_.data() + here.first_edge;
+        const Edge *last =
+            index_.edges_.data() + index_.nodes_[node + 1].first_edge;
+        for (const Edge *e = first; e != last; ++e) {
+            const size_t *cells = other;
+            if (InBand(e->label, lo, hi)) {
+                FillRow(row, depth, lo, hi, e->label, next);
+                cells = next;
+            } else if (other_best > bound_) {
+                continue;
+            }
+            if (!Reachable(cells, lo, hi, *e)) continue;
+            if (cells == other) {
+                std::copy(other + lo, other + hi + 1, next + lo);
+            }
+            Visit(e->child, depth + 1);
+        }
+    }
+
+    // Whether query[j - 1] is 'label' for some j in [max(lo, 1), hi].
+    bool InBand(unsigned char label, size_t lo, size_t hi) const {
+        const size_t begin = std::max<size_t>(lo, 1) - 1;
+        if (!masks_.empty()) {
+            const uint64_t window =
+                (hi - begin == 64 ? ~0ULL : (1ULL << (hi - begin)) - 1)
+                << begin;
+            return (masks_[label] & window) != 0;
+        }
+        for (size_t j = begin; j < hi; ++j) {
+            if (static_cast<unsigned char>(query_[j]) == label) return true;
+        }
+        return false;
+    }
+
+    // Fills next[lo, hi], the row after the byte 'label' (-1 for a byte not
+    // in the query) below 'row', the row of 'depth'. The cells out of the
+    // band read as band_ + 1. Returns the lowest cell.
+    size_t FillRow(const size_t *row, size_t depth, size_t lo, size_t hi,
+                   int label, size_t *next) const {
+        const size_t far = band_ + 1;
+        size_t left = lo > 0 ? far : depth + 1;
+        size_t best = far;
+        if (lo == 0) {
+            next[0] = left;
+            best = left;
+        }
+        for (size_t j = std::max<size_t>(lo, 1); j <= hi; ++j) {
+            const size_t above = j < depth + band_ + 1 ? row[j] : far;
+            const size_t replace =
+                row[j - 1] +
+                (static_cast<unsigned char>(query_[j - 1]) != label);
+            left = std::min(std::min(replace, above + 1), left + 1);
+            left = std::min(left, far);
+            next[j] = left;
+            best = std::min(best, left);
+        }
+        return best;
+    }
+
+    // An entry below the child of 'edge' is at least cells[j] plus the
+    // difference between the rest of the query and the rest of the entry
+    // away, for the best j.
+    bool Reachable(const size_t *cells, size_t lo, size_t hi,
+                   const Edge &edge) const {
+        const size_t shortest = edge.shortest;
+        const size_t longest =
+            edge.longest == kLengthCap ? SIZE_MAX : edge.longest;
+        for (size_t j = lo; j <= hi; ++j) {
+            const size_t rest = query_.size() - j;
+            const size_t gap = rest < shortest  ? shortest - rest
+                               : rest > longest ? rest - longest
+                                                : 0;
+            if (cells[j] + gap <= bound_) return true;
+        }
+        return false;
+    }
+
+    // Keeps the limit_ closest matches in a max-heap; once it is full, only
+    // as close matches can still get in.
+    void Offer(size_t id, size_t distance) {
+        const Match match = {id, distance};
+        if (matches_.size() == limit_) {
+            if (!Closer(match, matches_.front())) return;
+            std::pop_heap(matches_.begin(), matches_.end(), Closer);
+            matches_.back() = match;
+        } else {
+            matches_.push_back(match);
+        }
+        std::push_heap(matches_.begin(), matches_.end(), Closer);
+        if (matches_.size() == limit_) bound_ = matches_.front().distance;
+    }
+
+    const FuzzyIndex &index_;
+    const std::string_view query_;
+    const size_t max_distance_;
+    // The band of the DP rows and the distance a match must be within; the
+    // bound drops when the limit_ matches are found.
+    size_t band_, bound_;
+    const size_t limit_;
+    // The DP row of each depth of the current path, and the row after a
+    // byte that is not in the band of the query, width_ cells each.
+    const size_t width_;
+    std::vector<size_t> rows_, others_;
+    std::vector<uint64_t> masks_;
+    std::vector<Match> matches_;
+};
+
+std::vector<FuzzyIndex::Match> FuzzyIndex::Lookup(std::string_view query,
+                                                  size_t max_distance,
+                                                  size_t limit) const {
+    // No entry is further than the longest of the two.
+    max_distance =
+        std::min(max_distance, std::max(query.size(), longest_entry_));
+    // Nor closer than the length difference.
+    if (query.size() > longest_entry_ + max_distance) {
+        return std::vector<Match>();
+    }
+    Search search(*this, query, max_distance, limit);
+    return search.Run();
+}
+
+}  // namespace edit_distance
@@ -0,0 +1,71 @@
+#ifndef EDIT_DISTANCE_FUZZY_INDEX_H
+#define EDIT_DISTANCE_FUZZY_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace edit_distance {
+// A dictionary of byte strings for fuzzy lookups: finds the entries within a
+// given Distance() of a query without computing the distance to each entry.
+//
+// The entries are stored in a trie laid out depth first, in two arrays of
+// 8 bytes per node (first edge, entry id) and per edge (child, byte, and
+// the shortest and longest entry suffix below the child). A lookup walks
+// the trie depth first, carrying the Levenshtein DP row of the current
+// prefix against the query, which is the state of a Levenshtein automaton
+// for the query. Only the diagonal band of width 2 * k + 1 of the row can
+// be within k. A subtree is skipped as soon as no cell of the band, plus
+// the length difference between the rest of the query and the rest of the
+// entries below, is within k, so a lookup touches a small part of the trie
+// for a small k.
+//
+// Immutable once built, so lookups can run concurrently.
+class FuzzyIndex {
+   public:
+    struct Match {
+        size_t id;        // Index of the entry in the constructor's words.
+        size_t distance;  // Distance() between the entry and the query.
+    };
+
+    // Indexes 'words'. An entry that occurs several times keeps the id of
+    // its first occurrence. At most 2^32 - 1 entries and trie nodes.
+    explicit FuzzyIndex(const std::vector<std::string> &words);
+
+    // Returns the (at most) 'limit' entries closest to 'query' among those
+    // at distance 'max_distance' or less, by increasing distance and then
+    // id.
+    std::vector<Match> Lookup(std::string_view query, size_t max_distance,
+                              size_t limit) const;
+
+    size_t nodes() const { return nodes_.size() - 1; }
+
+   private:
+    class Search;
+
+    struct Node {
+        uint32_t first_edge;
+        uint32_t word;  // Id plus one of the entry ending here, 0 for none.
+    };
+    struct Edge {
+        uint32_t child;
+        unsigned char label;
+        // Shortest and longest entry suffix below 'child', capped at 255.
+        unsigned char shortest, longest;
+    };
+
+    // Node i has the edges [nodes_[i].first_edge, nodes_[i + 1].first_edge),
+    // sorted by label. The nodes are numbered depth first and a last node
+    // ends the edges of the real last one.
+    std::vector<Node> nodes_;
+    std::vector<Edge> edges_;
+    // Length of the longest entry.
+    size_t longest_entry_;
+};
+
+}  // namespace edit_distance
+
+#endif  // EDIT_DISTANCE_FUZZY_INDEX_H
@@ -0,0 +1,127 @@
+/* Similarity join of the lines of two files, with the pairs each filter
+ * let through and the time it took.
+ *
+ * Usage: join_bench [-k max_distance] [-q gram_size] [-t threads] [-p]
+ *                   left right
+ *
+ * The report goes to stderr, and with -p the joined pairs go to stdout as
+ * "left line<TAB>right line<TAB>distance", numbered from 1.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string_view>
+#include <vector>
+
+#include "edit_distance.h"
+#include "similarity_join.h"
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-k max_distance] [-q gram_size] [-t threads] [-p] "
+            "left right\n"
+            "  -k  pairs up to this edit distance are joined (default 1)\n"
+            "  -q  length of the q-grams of the filters (default 3)\n"
+            "  -t  threads, 0 for all the hardware threads (default 0)\n"
+            "  -p  print the joined pairs\n",
+            program);
+}
+
+// Parses a plain decimal number into 'value'.
+static bool parse_size(const char *text, size_t *value) {
+    char *end;
+    errno = 0;
+    *value = strtoul(text, &end, 10);
+    return *text != '\0' && *end == '\0' && errno == 0 && *text != '-';
+}
+
+// Prints a stage of the join, with the share of all the pairs and of the
+// previous stage it let through.
+static void report(const char *stage, size_t count, size_t all,
+                   size_t previous) {
+    fprintf(stderr, "%-13s %15zu  %10.3g of all  %10.3g of previous\n", stage,
+            count, all ? static_cast<double>(count) / all : 0.0,
+            previous ? static_cast<double>(count) / previous : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    edit_distance::JoinOptions options;
+    bool print = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:q:t:p")) != -1) {
+        switch (opt) {
+            case 'k':
+                if (!parse_size(optarg, &options.max_distance)) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'q':
+                if (!parse_size(optarg, &options.gram_size)) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 't':
+                if (!parse_size(optarg, &options.threads)) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'p':
+                print = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    edit_distance::MappedLines left, right;
+    for (int i = 0; i < 2; ++i) {
+        const char *path = argv[optind + i];
+        if (!(i == 0 ? left : right).Open(path)) {
+            fprintf(stderr, "%s: cannot read %s: %s\n", argv[0], path,
+                    strerror(errno));
+            return 2;
+        }
+    }
+
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    edit_distance::JoinStats stats;
+    const std::vector<edit_distance::JoinPair> pairs =
+        edit_distance::SimilarityJoin(left.lines(), right.lines(), options,
+                                      &stats);
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+    fprintf(stderr, "%zu x %zu lines, k = %zu, q = %zu: %.3f s\n",
+            left.lines().size(), right.lines().size(), options.max_distance,
+            options.gram_size, seconds);
+    report("pairs", stats.pairs, stats.pairs, stats.pairs);
+    report("length", stats.length_pairs, stats.pairs, stats.pairs);
+    report("prefix", stats.candidates, stats.pairs, stats.length_pairs);
+    report("count", stats.verified, stats.pairs, stats.candidates);
+    report("matches", stats.matches, stats.pairs, stats.verified);
+
+    if (print) {
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            printf("%zu\t%zu\t%zu\n", pairs[i].left + 1, pairs[i].right + 1,
+                   pairs[i].distance);
+        }
+    }
+    if (fflush(stdout) != 0) return 2;
+    return 0;
+}
@@ -0,0 +1,85 @@
+/* All-pairs distance matrix of the lines of a file, with the time it took.
+ *
+ * Usage: matrix_bench [-t threads] [-p] file
+ *
+ * The report goes to stderr, and with -p the condensed matrix goes to
+ * stdout, one distance per line (see CondensedIndex).
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string_view>
+#include <vector>
+
+#include "distance_matrix.h"
+#include "edit_distance.h"
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-t threads] [-p] file\n"
+            "  -t  threads, 0 for all the hardware threads (default 0)\n"
+            "  -p  print the condensed matrix\n",
+            program);
+}
+
+int main(int argc, char *argv[]) {
+    size_t threads = 0;
+    bool print = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:p")) != -1) {
+        switch (opt) {
+            case 't': {
+                char *end;
+                errno = 0;
+                threads = strtoul(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || errno != 0 ||
+                    *optarg == '-') {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            }
+            case 'p':
+                print = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    edit_distance::MappedLines lines;
+    if (!lines.Open(argv[optind])) {
+        fprintf(stderr, "%s: cannot read %s: %s\n", argv[0], argv[optind],
+                strerror(errno));
+        return 2;
+    }
+
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    const std::vector<uint32_t> matrix =
+        edit_distance::DistanceMatrix(lines.lines(), threads);
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+
+    fprintf(stderr, "%zu lines, %zu pairs: %.3f s, %.4g pairs/s\n",
+            lines.lines().size(), matrix.size(), seconds,
+            seconds > 0 ? matrix.size() / seconds : 0.0);
+
+    if (print) {
+        for (size_t i = 0; i < matrix.size(); ++i) printf("%u\n", matrix[i]);
+    }
+    if (fflush(stdout) != 0) return 2;
+    return 0;
+}
@@ -0,0 +1,310 @@
+#include "patch.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace edit_distance {
+// Drops 'prefix' from the start of 'text'. Returns false, leaving 'text'
+// untouched, when it does not start with it.
+bool ConsumePrefix(std::string_view *text, std::string_view prefix) {
+    if (text->substr(0, prefix.size()) != prefix) return false;
+    text->remove_prefix(prefix.size());
+    return true;
+}
+
+// Parses the decimal number at the start of 'text' and drops it. Returns
+// false when there is none or it overflows.
+bool ConsumeNumber(std::string_view *text, size_t *number) {
+    size_t i = 0;
+    *number = 0;
+    for (; i < text->size() && (*text)[i] >= '0' && (*text)[i] <= '9'; ++i) {
+        const size_t digit = (*text)[i] - '0';
+        if (*number > (static_cast<size_t>(-1) - digit) / 10) return false;
+        *number = *number * 10 + digit;
+    }
+    text->remove_prefix(i);
+    return i > 0;
+}
+
+// Parses the "<start>,<length>" of one side of a hunk header, 'sign' first.
+// Returns false when it is not there; 'line' is then untouched.
+bool ConsumeRange(std::string_view *line, char sign, size_t *start,
+                  size_t *length) {
+    std::string_view rest = *line;
+    if (!ConsumePrefix(&rest, std::string_view(&sign, 1)) ||
+        !ConsumeNumber(&rest, start) || !ConsumePrefix(&rest, ",") ||
+        !ConsumeNumber(&rest, length) || *start == 0) {
+        return false;
+    }
+    *line = rest;
+    return true;
+}
+
+// The lines of 'text', without their '\n'; the last one is kept even
+// without a '\n'.
+void SplitLines(std::string_view text, std::vector<std::string_view> *lines) {
+    size_t start = 0;
+    while (start < text.size()) {
+        const char *end = static_cast<const char *>(
+            std::memchr(text.data() + start, '\n', text.size() - start));
+        const size_t line_end = end ? end - text.data() : text.size();
+        lines->push_back(text.substr(start, line_end - start));
+        start = line_end + 1;
+    }
+}
+
+bool ParsePatch(std::string_view text, Patch *patch, size_t *error_line) {
+    patch->text = text;
+    patch->lines.clear();
+    patch->hunks.clear();
+    std::vector<std::string_view> lines;
+    SplitLines(text, &lines);
+
+    size_t i = 0;
+    while (i < lines.size() && (lines[i].substr(0, 4) == "--- " ||
+                                lines[i].substr(0, 4) == "+++ ")) {
+        ++i;
+    }
+    // Lines added minus lines removed by the hunks so far.
+    ptrdiff_t shift = 0;
+    size_t left_end = 0;
+    while (i < lines.size()) {
+        *error_line = i + 1;
+        std::string_view header = lines[i++];
+        size_t left_start = 0, left_length = 0, right_start = 0,
+               right_length = 0;
+        if (!ConsumePrefix(&header, "@@ ")) return false;
+        const bool has_left =
+            ConsumeRange(&header, '-', &left_start, &left_length);
+        if (has_left && !ConsumePrefix(&header, " ")) return false;
+        const bool has_right =
+            ConsumeRange(&header, '+', &right_start, &right_length);
+        if (has_right && !ConsumePrefix(&header, " ")) return false;
+        if ((!has_left && !has_right) || header != "@@") return false;
+
+        PatchHunk hunk;
+        hunk.lines_begin = patch->lines.size();
+        size_t adds = 0, removes = 0, common = 0;
+        for (; i < lines.size() && lines[i].substr(0, 1) != "@"; ++i) {
+            *error_line = i + 1;
+            switch (lines[i].empty() ? '\0' : lines[i][0]) {
+                case ' ':
+                    ++common;
+                    break;
+                case '-':
+                    ++removes;
+                    break;
+                case '+':
+                    ++adds;
+                    break;
+                default:
+                    return false;
+            }
+            patch->lines.push_back(lines[i]);
+        }
+        hunk.lines_end = patch->lines.size();
+        hunk.left_length = removes + common;
+
+        if (has_left ? left_length != removes + common : removes > 0) {
+            return false;
+        }
+        if (has_right ? right_length != adds + common : adds > 0) {
+            return false;
+        }
+        if (has_left) {
+            hunk.left_start = left_start - 1;
+            hunk.right_start = hunk.left_start + shift;
+        } else {
+            hunk.right_start = right_start - 1;
+            if (static_cast<ptrdiff_t>(hunk.right_start) < shift) return false;
+            hunk.left_start = hunk.right_start - shift;
+        }
+        if (hunk.left_start < left_end) return false;
+        left_end = hunk.left_start + hunk.left_length;
+        shift += static_cast<ptrdiff_t>(adds) - static_cast<ptrdiff_t>(removes);
+        patch->hunks.push_back(hunk);
+    }
+    return true;
+}
+
+// Collects the pieces of ApplyPatch, joining the spans of the original that
+// follow each other.
+class PieceList {
+   public:
+    PieceList(std::string_view original, std::vector<std::string_view> *pieces)
+        : original_(original), pieces_(*pieces) {
+        pieces_.clear();
+    }
+
+    // Appends the original from 'begin' to 'end'.
+    void AppendOriginal(const char *begin, const char *end) {
+        if (begin == end) return;
+        if (!pieces_.empty() &&
+            pieces_.back().data() + pieces_.back().size() == begin) {
+            pieces_.back() = std::string_view(
+                pieces_.back().data(), end - pieces_.back().data());
+        } else {
+            pieces_.push_back(std::string_view(begin, end - begin));
+        }
+    }
+
+    // Appends 'line', a line of 'patch' without its '+', and its '\n'.
+    void AppendAdded(std::string_view line, std::string_view patch) {
+        // The last line of the original may have no '\n'.
+        if (!pieces_.empty() &&
+            pieces_.back().data() + pieces_.back().size() ==
+                original_.data() + original_.size() &&
+            original_.back() != '\n') {
+            pieces_.push_back("\n");
+        }
+        if (line.data() + line.size() < patch.data() + patch.size()) {
+            pieces_.push_back(std::string_view(line.data(), line.size() + 1));
+        } else {
+            pieces_.push_back(line);
+            pieces_.push_back("\n");
+        }
+    }
+
+   private:
+    const std::string_view original_;
+    std::vector<std::string_view> &pieces_;
+};
+
+// Returns the start of the line after the one at 'p'.
+inline const char *NextLine(const char *p, const char *end) {
+    const char *newline =
+        static_cast<const char *>(std::memchr(p, '\n', end - p));
+    return newline ? newline + 1 : end;
+}
+
+// Returns whether the lines that 'hunk' keeps and removes are the lines
+// starting at starts[first], each ending at the next start.
+bool HunkMatches(const Patch &patch, const PatchHunk &hunk,
+                 const std::vector<const char *> &starts, size_t first) {
+    if (first + hunk.left_length >= starts.size()) return false;
+    size_t line = first;
+    for (size_t i = hunk.lines_begin; i < hunk.lines_end; ++i) {
+        const std::string_view text = patch.lines[i];
+        if (text[0] == '+') continue;
+        size_t size = starts[line + 1] - starts[line];
+        if (size > 0 && starts[line][size - 1] == '\n') --size;
+        if (std::string_view(starts[line], size) != text.substr(1)) {
+            return false;
+        }
+        ++line;
+    }
+    return true;
+}
+
+bool ApplyPatch(std::string_view original, const Patch &patch, size_t window,
+                std::vector<std::string_view> *pieces, size_t *failed_hunk) {
+    PieceList out(original, pieces);
+    const char *const end = original.data() + original.size();
+    // The original up to 'copied' is in the pieces, and 'p' is the start of
+    // line 'line', at or after it.
+    const char *copied = original.data(), *p = copied;
+    size_t line = 0;
+    // Lines the hunks so far were moved by.
+    ptrdiff_t offset = 0;
+    // The starts of the lines a hunk may cover, then the end of the last.
+    std::vector<const char *> starts;
+    for (size_t h = 0; h < patch.hunks.size(); ++h) {
+        const PatchHunk &hunk = patch.hunks[h];
+        const ptrdiff_t moved =
+            static_cast<ptrdiff_t>(hunk.left_start) + offset;
+        const size_t expected = std::max<ptrdiff_t>(moved, line);
+        const size_t lowest =
+            std::max(line, expected - std::min(expected, window));
+        for (; line < lowest && p < end; ++line) p = NextLine(p, end);
+
+        starts.assign(1, p);
+        const size_t lines = expected + window - line + hunk.left_length;
+        for (const char *q = p; starts.size() <= lines && q < end;) {
+            q = NextLine(q, end);
+            starts.push_back(q);
+        }
+
+        // expected, expected - 1, expected + 1, ..., never before 'line'.
+        size_t first = static_cast<size_t>(-1);
+        for (size_t distance = 0; distance <= window; ++distance) {
+            if (expected >= line + distance &&
+                HunkMatches(patch, hunk, starts,
+                            expected - distance - line)) {
+                first = expected - distance;
+                break;
+            }
+            if (distance > 0 &&
+                HunkMatches(patch, hunk, starts, expected + distance - line)) {
+                first = expected + distance;
+                break;
+            }
+        }
+        if (first == static_cast<size_t>(-1)) {
+            *failed_hunk = h;
+            return false;
+        }
+        offset = static_cast<ptrdiff_t>(first) -
+                 static_cast<ptrdiff_t>(hunk.left_start);
+
+        // The kept lines stay in the span of the original that runs from
+        // 'copied'; a removed line ends it, and the next one starts after.
+        size_t at = first - line;
+        for (size_t i = hunk.lines_begin; i < hunk.lines_end; ++i) {
+            const std::string_view text = patch.lines[i];
+            if (text[0] == ' ') {
+                ++at;
+            } else if (text[0] == '-') {
+                out.AppendOriginal(copied, starts[at]);
+                copied = starts[++at];
+            } else {
+                out.AppendOriginal(copied, starts[at]);
+                copied = starts[at];
+                out.AppendAdded(text.substr(1), patch.text);
+            }
+        }
+        p = starts[at];
+        line = first + hunk.left_length;
+    }
+    out.AppendOriginal(copied, end);
+    return true;
+}
+
+bool WritePieces(int fd, const std::vector<std::string_view> &pieces) {
+    std::vector<struct iovec> vectors(std::min<size_t>(pieces.size(), IOV_MAX));
+    for (size_t done = 0; done < pieces.size();) {
+        const size_t count = std::min(vectors.size(), pieces.size() - done);
+        for (size_t i = 0; i < count; ++i) {
+            vectors[i].iov_base = const_cast<char *>(pieces[done + i].data());
+            vectors[i].iov_len = pieces[done + i].size();
+        }
+        // A short write leaves the rest of the pieces for the next call.
+        struct iovec *vector = vectors.data();
+        size_t left = count;
+        while (left > 0) {
+            const ssize_t written = writev(fd, vector, left);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            size_t size = written;
+            while (left > 0 && size >= vector->iov_len) {
+                size -= vector->iov_len;
+                ++vector;
+                --left;
+            }
+            if (left > 0) {
+                vector->iov_base = static_cast<char *>(vector->iov_base) + size;
+                vector->iov_len -= size;
+            }
+        }
+        done += count;
+    }
+    return true;
+}
+
+}  // namespace edit_distance
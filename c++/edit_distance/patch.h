@@ -0,0 +1,63 @@
+#ifndef EDIT_DISTANCE_PATCH_H
+#define EDIT_DISTANCE_PATCH_H
+
+#include <stddef.h>
+
+#include <string_view>
+#include <vector>
+
+namespace edit_distance {
+// A hunk of a parsed patch.
+struct PatchHunk {
+    // The first line of the hunk in the original and in the result, from 0.
+    size_t left_start, right_start;
+    // The lines of the hunk in Patch::lines.
+    size_t lines_begin, lines_end;
+    // The lines of the original that the hunk keeps or removes.
+    size_t left_length;
+};
+
+// A unified diff in the format of CreateUnifiedDiff. The lines point into
+// the text of the patch, which must outlive it.
+struct Patch {
+    std::string_view text;
+    // The lines of all the hunks, each with its ' ', '-' or '+' and without
+    // its '\n'.
+    std::vector<std::string_view> lines;
+    std::vector<PatchHunk> hunks;
+};
+
+// Parses 'text', the hunks of CreateUnifiedDiff or fdiff: a header
+//   "@@ -<left_start>,<left_length> +<right_start>,<right_length> @@"
+// where the left part is left out when the hunk removes nothing and the
+// right part when it adds nothing, then the lines of the hunk. The start
+// a header leaves out follows from the hunks before it. The "--- " and
+// "+++ " file header of fdiff is skipped. Diffs with intraline marks are
+// not patches: the marks would end up in the result.
+// Returns false, with the line of 'text' it stopped at in 'error_line',
+// from 1, when a header or a line is malformed, the lengths of a header do
+// not match its lines, or the hunks are not in order.
+bool ParsePatch(std::string_view text, Patch *patch, size_t *error_line);
+
+// Applies 'patch' to 'original', as the pieces of the result in order:
+// spans of 'original', taken whole between and inside the hunks, and the
+// added lines of the patch. Nothing is copied, so the memory used is one
+// string_view per hunk and added line, whatever the size of the original.
+//
+// A hunk applies where the lines it keeps and removes match the original
+// exactly. It is tried at its own start, moved by as many lines as the
+// hunks before it were, then up to 'window' lines before and after, the
+// nearest first. The lines are scanned once, from the start of the
+// original to the last hunk, so a patch applies in one pass over the file.
+// Returns false, with the index of the hunk in 'failed_hunk', when a hunk
+// matches nowhere in its window.
+bool ApplyPatch(std::string_view original, const Patch &patch, size_t window,
+                std::vector<std::string_view> *pieces, size_t *failed_hunk);
+
+// Writes 'pieces' to 'fd' with writev, IOV_MAX of them per call. Returns
+// false, with errno set, on a write error.
+bool WritePieces(int fd, const std::vector<std::string_view> &pieces);
+
+}  // namespace edit_distance
+
+#endif  // EDIT_DISTANCE_PATCH_H
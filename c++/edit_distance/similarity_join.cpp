@@ -0,0 +1,369 @@
+#include "similarity_join.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "edit_distance.h"
+
+namespace edit_distance {
+// Left strings handed to a join thread at a time.
+const size_t kJoinChunk = 256;
+// Longest gram: a key packs the gram in the upper 7 bytes of an integer
+// and the occurrence number, capped at 255, in the lowest one.
+const size_t kMaxGramSize = 7;
+
+// The gram keys of a string, sorted: each gram with its occurrence number
+// in the string, so that shared keys count the common grams with
+// multiplicity.
+void GetGramKeys(std::string_view str, size_t gram_size,
+                 std::vector<uint64_t> *keys) {
+    keys->clear();
+    if (str.size() < gram_size) return;
+    for (size_t i = 0; i + gram_size <= str.size(); ++i) {
+        uint64_t gram = 0;
+        std::memcpy(&gram, str.data() + i, gram_size);
+        keys->push_back(gram << 8);
+    }
+    std::sort(keys->begin(), keys->end());
+    for (size_t i = 1; i < keys->size(); ++i) {
+        const uint64_t previous = (*keys)[i - 1];
+        if ((*keys)[i] == (previous & ~0xffULL) && (previous & 0xff) < 0xff) {
+            (*keys)[i] = previous + 1;
+        }
+    }
+}
+
+// Number of keys shared by two sorted key lists, with multiplicity.
+size_t CountSharedKeys(const uint64_t *a, const uint64_t *a_end,
+                       const uint64_t *b, const uint64_t *b_end) {
+    size_t shared = 0;
+    while (a != a_end && b != b_end) {
+        if (*a < *b) {
+            ++a;
+        } else if (*b < *a) {
+            ++b;
+        } else {
+            ++shared;
+            ++a;
+            ++b;
+        }
+    }
+    return shared;
+}
+
+// Index of the gram keys of the right strings. The strings are numbered by
+// increasing length (their rank), so that a length range is a rank range.
+// The keys of the whole vocabulary are numbered by increasing document
+// frequency, the order of the prefix filter, and only the first keys of
+// each string in that order are in the posting lists.
+class GramIndex {
+   public:
+    GramIndex(const std::vector<std::string_view> &strings, size_t gram_size,
+              size_t prefix)
+        : order_(strings.size()),
+          lengths_(strings.size()),
+          key_starts_(1, 0),
+          prefix_(prefix) {
+        for (size_t i = 0; i < strings.size(); ++i) order_[i] = i;
+        std::stable_sort(order_.begin(), order_.end(),
+                         [&strings](size_t a, size_t b) {
+                             return strings[a].size() < strings[b].size();
+                         });
+        std::vector<uint64_t> keys;
+        for (size_t rank = 0; rank < order_.size(); ++rank) {
+            const std::string_view str = strings[order_[rank]];
+            lengths_[rank] = str.size();
+            GetGramKeys(str, gram_size, &keys);
+            keys_.insert(keys_.end(), keys.begin(), keys.end());
+            key_starts_.push_back(keys_.size());
+        }
+
+        // The vocabulary with the document frequency of each key, then its
+        // rank in the (frequency, key) order.
+        vocabulary_ = keys_;
+        std::sort(vocabulary_.begin(), vocabulary_.end());
+        std::vector<uint32_t> frequencies;
+        size_t unique = 0;
+        for (size_t i = 0; i < vocabulary_.size(); ++unique) {
+            size_t j = i + 1;
+            while (j < vocabulary_.size() && vocabulary_[j] == vocabulary_[i]) {
+                ++j;
+            }
+            vocabulary_[unique] = vocabulary_[i];
+            frequencies.push_back(j - i);
+            i = j;
+        }
+        vocabulary_.resize(unique);
+        vocabulary_.shrink_to_fit();
+        std::vector<uint32_t> by_frequency(unique);
+        for (size_t i = 0; i < unique; ++i) by_frequency[i] = i;
+        std::stable_sort(by_frequency.begin(), by_frequency.end(),
+                         [&frequencies](uint32_t a, uint32_t b) {
+                             return frequencies[a] < frequencies[b];
+                         });
+        // Key 0 is for the keys of no right string, which come first.
+        order_of_key_.resize(unique);
+        for (size_t i = 0; i < unique; ++i) {
+            order_of_key_[by_frequency[i]] = i + 1;
+        }
+
+        // Posting lists of the prefixes, by key order then rank.
+        std::vector<uint32_t> orders;
+        posting_starts_.assign(unique + 2, 0);
+        for (size_t rank = 0; rank < order_.size(); ++rank) {
+            GetPrefix(rank, &orders);
+            for (size_t i = 0; i < orders.size(); ++i) {
+                ++posting_starts_[orders[i] + 1];
+            }
+        }
+        for (size_t i = 1; i < posting_starts_.size(); ++i) {
+            posting_starts_[i] += posting_starts_[i - 1];
+        }
+        postings_.resize(posting_starts_.back());
+        std::vector<size_t> fill(posting_starts_.begin(),
+                                 posting_starts_.end() - 1);
+        for (size_t rank = 0; rank < order_.size(); ++rank) {
+            GetPrefix(rank, &orders);
+            for (size_t i = 0; i < orders.size(); ++i) {
+                postings_[fill[orders[i]]++] = rank;
+            }
+        }
+    }
+
+    // Index of the string of rank 'rank'.
+    size_t id(size_t rank) const { return order_[rank]; }
+    size_t length(size_t rank) const { return lengths_[rank]; }
+    // Sorted keys of the string of rank 'rank'.
+    const uint64_t *keys_begin(size_t rank) const {
+        return keys_.data() + key_starts_[rank];
+    }
+    const uint64_t *keys_end(size_t rank) const {
+        return keys_.data() + key_starts_[rank + 1];
+    }
+
+    // First rank of the strings of 'length' bytes or more.
+    size_t FirstRank(size_t length) const {
+        return std::lower_bound(lengths_.begin(), lengths_.end(), length) -
+               lengths_.begin();
+    }
+
+    // Position of 'key' in the prefix filter order, 0 if no right string
+    // has it.
+    uint32_t KeyOrder(uint64_t key) const {
+        const std::vector<uint64_t>::const_iterator it =
+            std::lower_bound(vocabulary_.begin(), vocabulary_.end(), key);
+        return it != vocabulary_.end() && *it == key
+                   ? order_of_key_[it - vocabulary_.begin()]
+                   : 0;
+    }
+
+    // The ranks in [first_rank, end_rank) of the strings with the key of
+    // order 'order' in their prefix, sorted.
+    const uint32_t *Find(uint32_t order, size_t first_rank) const {
+        return std::lower_bound(postings_.data() + posting_starts_[order],
+                                postings_.data() + posting_starts_[order + 1],
+                                first_rank);
+    }
+    const uint32_t *End(uint32_t order) const {
+        return postings_.data() + posting_starts_[order + 1];
+    }
+
+   private:
+    // The key orders of the prefix of the string of rank 'rank'.
+    void GetPrefix(size_t rank, std::vector<uint32_t> *orders) const {
+        orders->clear();
+        for (const uint64_t *key = keys_begin(rank); key != keys_end(rank);
+             ++key) {
+            orders->push_back(KeyOrder(*key));
+        }
+        const size_t size = std::min(prefix_, orders->size());
+        std::partial_sort(orders->begin(), orders->begin() + size,
+                          orders->end());
+        orders->resize(size);
+    }
+
+    std::vector<size_t> order_, lengths_;
+    // The keys of rank i are keys_[key_starts_[i], key_starts_[i + 1]).
+    std::vector<uint64_t> keys_;
+    std::vector<size_t> key_starts_;
+    // Sorted distinct keys, and their position in the prefix order.
+    std::vector<uint64_t> vocabulary_;
+    std::vector<uint32_t> order_of_key_;
+    // The ranks with the key of order i in their prefix are
+    // postings_[posting_starts_[i], posting_starts_[i + 1]).
+    std::vector<size_t> posting_starts_;
+    std::vector<uint32_t> postings_;
+    const size_t prefix_;
+};
+
+// The state of one join thread.
+class JoinWorker {
+   public:
+    JoinWorker(const std::vector<std::string_view> &left,
+               const std::vector<std::string_view> &right,
+               const GramIndex &index, const JoinOptions &options)
+        : left_(left),
+          right_(right),
+          index_(index),
+          options_(options),
+          seen_(right.size()) {}
+
+    void Join(size_t l_i) {
+        const std::string_view str = left_[l_i];
+        const size_t k = options_.max_distance, q = options_.gram_size;
+        const size_t first_rank = index_.FirstRank(str.size() - std::min(
+                                                       str.size(), k));
+        const size_t end_rank = index_.FirstRank(str.size() + k + 1);
+        stats_.length_pairs += end_rank - first_rank;
+
+        // With both strings at most this long, the count filter requires
+        // no common gram at all: these pairs are verified as they are.
+        const size_t unfiltered = q * (k + 1) - 1;
+        size_t rank = first_rank;
+        if (str.size() <= unfiltered) {
+            const size_t unfiltered_end =
+                std::min(end_rank, index_.FirstRank(unfiltered + 1));
+            for (; rank < unfiltered_end; ++rank) {
+                ++stats_.candidates;
+                Verify(l_i, rank);
+            }
+        }
+        if (rank == end_rank) return;
+
+        GetGramKeys(str, q, &keys_);
+        orders_.clear();
+        for (size_t i = 0; i < keys_.size(); ++i) {
+            orders_.push_back(index_.KeyOrder(keys_[i]));
+        }
+        const size_t prefix = std::min(q * k + 1, orders_.size());
+        std::partial_sort(orders_.begin(), orders_.begin() + prefix,
+                          orders_.end());
+        // Keys of no right string lead nowhere.
+        const size_t first = std::upper_bound(orders_.begin(),
+                                              orders_.begin() + prefix, 0) -
+                             orders_.begin();
+        ++stamp_;
+        for (size_t i = first; i < prefix; ++i) {
+            const uint32_t *end = index_.End(orders_[i]);
+            for (const uint32_t *r = index_.Find(orders_[i], rank);
+                 r != end && *r < end_rank; ++r) {
+                if (seen_[*r] == stamp_) continue;
+                seen_[*r] = stamp_;
+                ++stats_.candidates;
+                const size_t longest = std::max(str.size(), index_.length(*r));
+                // longest > unfiltered, so this is positive.
+                const size_t threshold = longest + 1 - q * (k + 1);
+                if (CountSharedKeys(keys_.data(), keys_.data() + keys_.size(),
+                                    index_.keys_begin(*r),
+                                    index_.keys_end(*r)) >= threshold) {
+                    Verify(l_i, *r);
+                }
+            }
+        }
+    }
+
+    const std::vector<JoinPair> &pairs() const { return pairs_; }
+    const JoinStats &stats() const { return stats_; }
+
+   private:
+    void Verify(size_t l_i, size_t rank) {
+        ++stats_.verified;
+        const size_t r_i = index_.id(rank);
+        const size_t distance = BoundedDistance(left_[l_i], right_[r_i],
+                                                options_.max_distance);
+        if (distance <= options_.max_distance) {
+            const JoinPair pair = {l_i, r_i, distance};
+            pairs_.push_back(pair);
+        }
+    }
+
+    const std::vector<std::string_view> &left_, &right_;
+    const GramIndex &index_;
+    const JoinOptions &options_;
+    // seen_[rank] is stamp_ once the rank is a candidate of the current
+    // left string.
+    std::vector<size_t> seen_;
+    size_t stamp_ = 0;
+    std::vector<uint64_t> keys_;
+    std::vector<uint32_t> orders_;
+    std::vector<JoinPair> pairs_;
+    JoinStats stats_;
+};
+
+std::vector<JoinPair> SimilarityJoin(const std::vector<std::string_view> &left,
+                                     const std::vector<std::string_view> &right,
+                                     const JoinOptions &join_options,
+                                     JoinStats *stats) {
+    JoinOptions options = join_options;
+    options.gram_size =
+        std::max<size_t>(1, std::min(options.gram_size, kMaxGramSize));
+    // No pair is further apart than the longest string, and a larger bound
+    // would overflow gram_size * (max_distance + 1).
+    size_t longest = 0;
+    for (size_t i = 0; i < left.size(); ++i) {
+        longest = std::max(longest, left[i].size());
+    }
+    for (size_t i = 0; i < right.size(); ++i) {
+        longest = std::max(longest, right[i].size());
+    }
+    options.max_distance = std::min(options.max_distance, longest);
+    const GramIndex index(right, options.gram_size,
+                          options.gram_size * options.max_distance + 1);
+    size_t threads = options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max<size_t>(1, std::min(threads, left.size() / kJoinChunk));
+
+    std::vector<JoinWorker> workers(
+        threads, JoinWorker(left, right, index, options));
+    std::atomic<size_t> next_chunk(0);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.push_back(std::thread([&, t]() {
+            for (size_t begin; (begin = kJoinChunk * next_chunk++) <
+                               left.size();) {
+                const size_t end = std::min(left.size(), begin + kJoinChunk);
+                for (size_t l_i = begin; l_i < end; ++l_i) {
+                    workers[t].Join(l_i);
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads; ++t) pool[t].join();
+
+    std::vector<JoinPair> pairs;
+    JoinStats total;
+    total.pairs = left.size() * right.size();
+    for (size_t t = 0; t < threads; ++t) {
+        pairs.insert(pairs.end(), workers[t].pairs().begin(),
+                     workers[t].pairs().end());
+        total.length_pairs += workers[t].stats().length_pairs;
+        total.candidates += workers[t].stats().candidates;
+        total.verified += workers[t].stats().verified;
+    }
+    total.matches = pairs.size();
+    std::sort(pairs.begin(), pairs.end(),
+              [](const JoinPair &a, const JoinPair &b) {
+                  return a.left != b.left ? a.left < b.left
+                                          : a.right < b.right;
+              });
+    if (stats) *stats = total;
+    return pairs;
+}
+
+std::vector<JoinPair> SimilarityJoin(const std::vector<std::string> &left,
+                                     const std::vector<std::string> &right,
+                                     const JoinOptions &options,
+                                     JoinStats *stats) {
+    return SimilarityJoin(
+        std::vector<std::string_view>(left.begin(), left.end()),
+        std::vector<std::string_view>(right.begin(), right.end()), options,
+        stats);
+}
+
+}  // namespace edit_distance
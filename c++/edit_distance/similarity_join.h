@@ -0,0 +1,70 @@
+#ifndef EDIT_DISTANCE_SIMILARITY_JOIN_H
+#define EDIT_DISTANCE_SIMILARITY_JOIN_H
+
+#include <stddef.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace edit_distance {
+// Options of SimilarityJoin.
+struct JoinOptions {
+    JoinOptions() : max_distance(1), gram_size(3), threads(0) {}
+
+    // Pairs up to this Distance() are joined.
+    size_t max_distance;
+    // Length of the q-grams of the filters, from 1 to 7. Longer grams are
+    // more selective, but the filters only apply to strings of at least
+    // gram_size * (max_distance + 1) bytes.
+    size_t gram_size;
+    // Threads of the join, 0 for all the hardware threads.
+    size_t threads;
+};
+
+// One joined pair.
+struct JoinPair {
+    size_t left, right;  // Indexes in the input lists.
+    size_t distance;
+};
+
+// How many pairs each stage of SimilarityJoin let through.
+struct JoinStats {
+    JoinStats()
+        : pairs(), length_pairs(), candidates(), verified(), matches() {}
+
+    size_t pairs;         // All the pairs, left.size() * right.size().
+    size_t length_pairs;  // Pairs whose lengths differ by max_distance or less.
+    size_t candidates;    // Of those, the pairs left by the prefix filter.
+    size_t verified;      // Of those, the pairs left by the count filter.
+    size_t matches;       // Of those, the pairs within max_distance.
+};
+
+// Returns all the pairs (l, r) with Distance(left[l], right[r]) <=
+// options.max_distance, sorted by l then r.
+//
+// The filters work on the q-grams of the strings, each occurrence of a gram
+// in a string being a distinct key. Two strings within distance k share at
+// least max(|l|, |r|) - q + 1 - k * q keys, since an edit breaks at most q
+// of them. So, with the keys of each string sorted from the rarest in
+// 'right' to the most common, they share one of their first k * q + 1 keys
+// (prefix filter), and only those are indexed and probed. 'right' is
+// indexed by length, a left string only probes the right strings of a
+// length within k (length filter), then counts the keys its candidates
+// really share (count filter) and verifies the rest with
+// BoundedDistance(). The left strings are spread over the threads.
+// 'stats' may be NULL.
+std::vector<JoinPair> SimilarityJoin(const std::vector<std::string_view> &left,
+                                     const std::vector<std::string_view> &right,
+                                     const JoinOptions &options,
+                                     JoinStats *stats);
+
+// Same as above, for strings.
+std::vector<JoinPair> SimilarityJoin(const std::vector<std::string> &left,
+                                     const std::vector<std::string> &right,
+                                     const JoinOptions &options,
+                                     JoinStats *stats);
+
+}  // namespace edit_distance
+
+#endif  // EDIT_DISTANCE_SIMILARITY_JOIN_H
@@ -0,0 +1,1029 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "cost_policy.h"
+#include "diff_cache.h"
+#include "distance_matrix.h"
+#include "edit_distance.h"
+#include "fuzzy_index.h"
+#include "patch.h"
+#include "similarity_join.h"
+
+using namespace edit_distance;
+
+// Heap allocations so far, for test_12. GCC takes the free() below for a
+// mismatch with the new of the callers it inlines them into.
+static std::atomic<size_t> allocations(0);
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t size) {
+    ++allocations;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    ++allocations;
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+
+#pragma GCC diagnostic pop
+
+static const Algorithm kAllAlgorithms[] = {
+    kWagnerFischer, kMyers, kLinearSpace, kParallel, kPatience, kHistogram,
+    kSorted};
+
+// Returns true if 'edits' turns 'left' into 'right'.
+bool is_valid_script(const std::vector<size_t> &left,
+                     const std::vector<size_t> &right,
+                     const std::vector<EditType> &edits) {
+    size_t l_i = 0, r_i = 0;
+    for (size_t i = 0; i < edits.size(); ++i) {
+        if (edits[i] == kMatch &&
+            (l_i >= left.size() || r_i >= right.size() ||
+             left[l_i] != right[r_i])) {
+            return false;
+        }
+        l_i += edits[i] != kAdd;
+        r_i += edits[i] != kRemove;
+    }
+    return l_i == left.size() && r_i == right.size();
+}
+
+std::vector<size_t> random_ids(size_t size, size_t alphabet) {
+    std::vector<size_t> ids(size);
+    for (size_t i = 0; i < size; ++i) ids[i] = rand() % alphabet;
+    return ids;
+}
+
+void write_file(const char *path, const char *content) {
+    FILE *file = fopen(path, "w");
+    assert(file);
+    fputs(content, file);
+    fclose(file);
+}
+
+// The reference Wagner-Fischer script (packed, integer-cost DP).
+void test_1() {
+    const size_t left[] = {1, 2, 3, 4, 5};
+    const size_t right[] = {1, 3, 4, 6, 5, 7};
+    const EditType expected[] = {kMatch, kRemove, kMatch, kMatch,
+                                 kAdd,   kMatch,  kAdd};
+    const std::vector<EditType> edits =
+        CalculateOptimalEdits(std::vector<size_t>(left, left + 5),
+                              std::vector<size_t>(right, right + 6));
+    assert(edits == std::vector<EditType>(expected, expected + 7));
+}
+
+// Every algorithm, with and without the reduction pre-pass: Myers, linear
+// space, AVX2, tiled parallel, patience and histogram.
+void test_2() {
+    for (int i = 0; i < 1000; ++i) {
+        const std::vector<size_t> left = random_ids(rand() % 100, 8);
+        const std::vector<size_t> right = random_ids(rand() % 100, 8);
+        const std::vector<EditType> reference =
+            CalculateOptimalEdits(left, right);
+        assert(is_valid_script(left, right, reference));
+        assert(CalculateOptimalEdits(left, right, kLinearSpace) == reference);
+        assert(CalculateParallelEdits(left, right, 3) == reference);
+        for (size_t a = 0; a < sizeof(kAllAlgorithms) / sizeof(Algorithm);
+             ++a) {
+            DiffOptions options;
+            options.algorithm = kAllAlgorithms[a];
+            assert(is_valid_script(
+                left, right, CalculateOptimalEdits(left, right, options)));
+            options.reduce = true;
+            assert(is_valid_script(
+                left, right, CalculateOptimalEdits(left, right, options)));
+        }
+    }
+
+    // Large enough for the vector kernel and for several tiles, partial
+    // ones included.
+    const std::vector<size_t> left = random_ids(1300, 4);
+    const std::vector<size_t> right = random_ids(1100, 4);
+    const std::vector<EditType> reference = CalculateOptimalEdits(left, right);
+    assert(is_valid_script(left, right, reference));
+    assert(CalculateOptimalEdits(left, right, kLinearSpace) == reference);
+    assert(CalculateParallelEdits(left, right, 1) == reference);
+    assert(CalculateParallelEdits(left, right, 3) == reference);
+}
+
+// Bit-parallel Distance and the banded, bounded variants.
+void test_3() {
+    assert(Distance("kitten", "sitting") == 3);
+    assert(Distance("", "abc") == 3);
+    assert(BoundedDistance("kitten", "sitting", 3) == 3);
+    assert(BoundedDistance("kitten", "sitting", 2) == 3);
+    assert(BoundedDistance("abc", "axc", SIZE_MAX) == 1);
+    assert(BoundedDistance("abc", "axc", size_t(1) << 62) == 1);
+
+    std::vector<EditType> edits;
+    const std::vector<size_t> left = random_ids(200, 4);
+    std::vector<size_t> right = left;
+    right[10] = 7;
+    right.erase(right.begin() + 100);
+    assert(Distance(left, right) == 2);
+    assert(!CalculateBoundedEdits(left, right, 1, &edits));
+    assert(edits.empty());
+    assert(CalculateBoundedEdits(left, right, 2, &edits));
+    assert(is_valid_script(left, right, edits));
+    assert(CalculateBoundedEdits(left, right, SIZE_MAX, &edits));
+    assert(edits == CalculateOptimalEdits(left, right));
+    assert(CalculateBoundedEdits(left, right, size_t(1) << 62, &edits));
+    assert(edits == CalculateOptimalEdits(left, right));
+}
+
+// Hunks of the streamed unified diff, with and without context.
+void test_4() {
+    const char *left[] = {"a", "b", "c", "d", "e", "f", "g", "h"};
+    const char *right[] = {"a", "x", "c", "d", "e", "f", "g", "h", "i"};
+    const std::string diff =
+        CreateUnifiedDiff(std::vector<std::string>(left, left + 8),
+                          std::vector<std::string>(right, right + 9));
+    assert(diff ==
+           "@@ -1,4 +1,4 @@\n a\n-b\n+x\n c\n d\n"
+           "@@ +7,3 @@\n g\n h\n+i\n");
+    assert(CreateUnifiedDiff(std::vector<std::string>(left, left + 8),
+                             std::vector<std::string>(right, right + 9),
+                             0) == "@@ -2,1 +2,1 @@\n-b\n+x\n@@ +9,1 @@\n+i\n");
+    assert(CalculateOptimalEdits(
+               std::vector<std::string_view>(left, left + 8),
+               std::vector<std::string_view>(right, right + 9)) ==
+           CalculateOptimalEdits(std::vector<std::string>(left, left + 8),
+                                 std::vector<std::string>(right, right + 9)));
+
+    std::string streamed;
+    WriteUnifiedDiff(
+        std::vector<std::string>(left, left + 8),
+        std::vector<std::string>(right, right + 9), DiffOptions(),
+        [&streamed](std::string_view block) { streamed += block; });
+    assert(streamed == diff);
+}
+
+// MappedLines and WriteFileDiff on files, /proc files and pipes.
+void test_5() {
+    char left_path[] = "/tmp/edit_distance_test_XXXXXX";
+    char right_path[] = "/tmp/edit_distance_test_XXXXXX";
+    close(mkstemp(left_path));
+    close(mkstemp(right_path));
+    write_file(left_path, "a\nb\nc\nd\n");
+    write_file(right_path, "a\nx\nc\nd\ne");
+
+    MappedLines lines;
+    assert(lines.Open(right_path));
+    assert(lines.lines().size() == 5);
+    assert(lines.lines()[4] == "e");
+    // Files of /proc are regular but report a size of 0: they are read.
+    assert(lines.Open("/proc/self/status"));
+    assert(lines.lines().size() > 1);
+    assert(lines.lines()[0].substr(0, 5) == "Name:");
+
+    DiffOptions options;
+    options.reduce = true;
+    std::string diff;
+    assert(WriteFileDiff(left_path, right_path, options,
+                         [&diff](std::string_view block) { diff += block; }));
+    assert(diff == "@@ -1,4 +1,5 @@\n a\n-b\n+x\n c\n d\n+e\n");
+    assert(!WriteFileDiff(left_path, "/nonexistent", options,
+                          [](std::string_view) {}));
+
+    // A pipe has no size and cannot be mapped: it is read instead.
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], "a\nx\n", 4) == 4);
+    close(fds[1]);
+    char pipe_path[64];
+    snprintf(pipe_path, sizeof(pipe_path), "/proc/self/fd/%d", fds[0]);
+    diff.clear();
+    assert(WriteFileDiff(left_path, pipe_path, options,
+                         [&diff](std::string_view block) { diff += block; }));
+    assert(diff == "@@ -1,4 +1,2 @@\n a\n-b\n-c\n-d\n+x\n");
+    close(fds[0]);
+    unlink(left_path);
+    unlink(right_path);
+}
+
+// FuzzyIndex against brute force.
+void test_6() {
+    std::vector<std::string> words;
+    for (int i = 0; i < 2000; ++i) {
+        std::string word(rand() % 8, ' ');
+        for (size_t j = 0; j < word.size(); ++j) word[j] = 'a' + rand() % 3;
+        words.push_back(word);
+    }
+    words.push_back(std::string(100, 'a'));
+    const FuzzyIndex index(words);
+
+    for (int i = 0; i < 200; ++i) {
+        std::string query(i < 190 ? rand() % 9 : 95 + rand() % 10, 'a');
+        for (size_t j = 0; j < query.size() && i < 190; ++j) {
+            query[j] = 'a' + rand() % 3;
+        }
+        const size_t max_distance = rand() % 4, limit = 1 + rand() % 20;
+
+        // The same by brute force: the first occurrences within the bound,
+        // by distance and then id.
+        std::vector<std::pair<size_t, size_t> > expected;
+        for (size_t id = 0; id < words.size(); ++id) {
+            const bool first =
+                std::find(words.begin(), words.begin() + id, words[id]) ==
+                words.begin() + id;
+            const size_t distance = Distance(query, words[id]);
+            if (first && distance <= max_distance) {
+                expected.push_back(std::make_pair(distance, id));
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        if (expected.size() > limit) expected.resize(limit);
+
+        const std::vector<FuzzyIndex::Match> matches =
+            index.Lookup(query, max_distance, limit);
+        assert(matches.size() == expected.size());
+        for (size_t k = 0; k < matches.size(); ++k) {
+            assert(matches[k].distance == expected[k].first);
+            assert(matches[k].id == expected[k].second);
+        }
+    }
+
+    // The rows only hold the band, so a long query costs little.
+    std::vector<std::string> short_words;
+    short_words.push_back("abcde");
+    short_words.push_back("abc");
+    short_words.push_back("x");
+    const FuzzyIndex short_index(short_words);
+    assert(short_index.Lookup(std::string(8000, 'a'), 3, 10).empty());
+    const std::vector<FuzzyIndex::Match> far =
+        short_index.Lookup(std::string(8000, 'a'), 8000, 10);
+    assert(far.size() == 3 && far[0].id == 0 && far[0].distance == 7999);
+    assert(far[2].id == 2 && far[2].distance == 8000);
+}
+
+// SimilarityJoin against brute force.
+void test_7() {
+    for (int i = 0; i < 50; ++i) {
+        std::vector<std::string> left(rand() % 200), right(rand() % 200);
+        for (size_t side = 0; side < 2; ++side) {
+            std::vector<std::string> &strings = side == 0 ? left : right;
+            for (size_t j = 0; j < strings.size(); ++j) {
+                strings[j].resize(rand() % 14);
+                for (size_t c = 0; c < strings[j].size(); ++c) {
+                    strings[j][c] = 'a' + rand() % 3;
+                }
+            }
+        }
+        JoinOptions options;
+        options.max_distance = rand() % 4;
+        options.gram_size = 1 + rand() % 4;
+        options.threads = 1 + rand() % 3;
+        JoinStats stats;
+        const std::vector<JoinPair> pairs =
+            SimilarityJoin(left, right, options, &stats);
+        assert(stats.pairs == left.size() * right.size());
+        assert(stats.matches == pairs.size());
+
+        size_t k = 0;
+        for (size_t l = 0; l < left.size(); ++l) {
+            for (size_t r = 0; r < right.size(); ++r) {
+                const size_t distance = Distance(left[l], right[r]);
+                if (distance > options.max_distance) continue;
+                assert(k < pairs.size());
+                assert(pairs[k].left == l && pairs[k].right == r);
+                assert(pairs[k].distance == distance);
+                ++k;
+            }
+        }
+        assert(k == pairs.size());
+    }
+
+    // A bound past every length joins every pair.
+    const std::vector<std::string> strings = {"ab", "", "xyz"};
+    JoinOptions options;
+    options.max_distance = SIZE_MAX;
+    assert(SimilarityJoin(strings, strings, options, NULL).size() == 9);
+}
+
+// DistanceMatrix against Distance, with strings of mixed lengths so that
+// the lanes of a batch end at different columns.
+void test_8() {
+    for (int i = 0; i < 30; ++i) {
+        std::vector<std::string> strings(rand() % 60);
+        for (size_t j = 0; j < strings.size(); ++j) {
+            strings[j].resize(rand() % (j % 7 == 0 ? 300 : 20));
+            for (size_t c = 0; c < strings[j].size(); ++c) {
+                strings[j][c] = 'a' + rand() % 4;
+            }
+        }
+        const std::vector<uint32_t> matrix =
+            DistanceMatrix(strings, 1 + rand() % 3);
+        const size_t n = strings.size();
+        assert(matrix.size() == (n < 2 ? 0 : n * (n - 1) / 2));
+        for (size_t l = 0; l < n; ++l) {
+            for (size_t r = l + 1; r < n; ++r) {
+                assert(matrix[CondensedIndex(n, l, r)] ==
+                       Distance(strings[l], strings[r]));
+            }
+        }
+    }
+}
+
+// The cost of 'edits' from 'left' to 'right' under the weights of
+// FixedCosts, checking that the script is valid.
+template <typename Sequence>
+size_t ScriptCost(const Sequence &left, const Sequence &right,
+                  const std::vector<EditType> &edits, size_t add,
+                  size_t remove, size_t replace) {
+    size_t l_i = 0, r_i = 0, cost = 0;
+    for (size_t i = 0; i < edits.size(); ++i) {
+        switch (edits[i]) {
+            case kMatch:
+                assert(left[l_i++] == right[r_i++]);
+                break;
+            case kReplace:
+                assert(left[l_i++] != right[r_i++]);
+                cost += replace;
+                break;
+            case kAdd:
+                ++r_i;
+                cost += add;
+                break;
+            case kRemove:
+                ++l_i;
+                cost += remove;
+                break;
+            case kTranspose:
+                assert(false);
+                break;
+        }
+    }
+    assert(l_i == left.size() && r_i == right.size());
+    return cost;
+}
+
+// The cost-policy DP: UnitCosts gives the reference script, and FixedCosts a
+// cheapest one.
+void test_9() {
+    for (int i = 0; i < 200; ++i) {
+        std::vector<size_t> left(rand() % 40), right(rand() % 40);
+        for (size_t j = 0; j < left.size(); ++j) left[j] = rand() % 4;
+        for (size_t j = 0; j < right.size(); ++j) right[j] = rand() % 4;
+        assert(CalculateOptimalEdits<UnitCosts>(left, right) ==
+               CalculateOptimalEdits(left, right));
+
+        std::vector<std::string> left_lines, right_lines;
+        for (size_t j = 0; j < left.size(); ++j) {
+            left_lines.push_back(std::string(1, 'a' + left[j]));
+        }
+        for (size_t j = 0; j < right.size(); ++j) {
+            right_lines.push_back(std::string(1, 'a' + right[j]));
+        }
+        assert(CalculateOptimalEdits<UnitCosts>(left_lines, right_lines) ==
+               CalculateOptimalEdits(left_lines, right_lines));
+
+        // A reference DP of the cost with adds 1, removes 3, replaces 2.
+        std::vector<std::vector<size_t>> dp(
+            left.size() + 1, std::vector<size_t>(right.size() + 1));
+        for (size_t l = 0; l <= left.size(); ++l) {
+            for (size_t r = 0; r <= right.size(); ++r) {
+                if (l == 0 || r == 0) {
+                    dp[l][r] = l * 3 + r;
+                    continue;
+                }
+                dp[l][r] = std::min(
+                    std::min(dp[l][r - 1] + 1, dp[l - 1][r] + 3),
+                    dp[l - 1][r - 1] + (left[l - 1] == right[r - 1] ? 0 : 2));
+            }
+        }
+        const std::vector<EditType> edits =
+            CalculateOptimalEdits<FixedCosts<1, 3, 2>>(left, right);
+        assert(ScriptCost(left, right, edits, 1, 3, 2) ==
+               dp[left.size()][right.size()]);
+        const std::vector<EditType> unit_edits =
+            CalculateOptimalEdits<FixedCosts<1, 1, 1>>(left, right);
+        assert(ScriptCost(left, right, unit_edits, 1, 1, 1) ==
+               Distance(left, right));
+    }
+
+    // A case-only replace is cheaper than an add and a remove.
+    const std::string hello = "Hello", lower = "hello";
+    const std::vector<EditType> edits =
+        CalculateOptimalEdits<CaseCosts<2, 2, 4, 1>>(hello, lower);
+    assert(edits.size() == 5 && edits[0] == kReplace);
+    assert((CalculateOptimalEdits<FixedCosts<1, 1, 4>>(hello, lower)[0] !=
+            kReplace));
+}
+
+// The optimal string alignment distance, by the textbook DP.
+template <typename Sequence>
+size_t ReferenceTranspositionDistance(const Sequence &left,
+                                      const Sequence &right) {
+    std::vector<std::vector<size_t>> dp(left.size() + 1,
+                                        std::vector<size_t>(right.size() + 1));
+    for (size_t l = 0; l <= left.size(); ++l) {
+        for (size_t r = 0; r <= right.size(); ++r) {
+            if (l == 0 || r == 0) {
+                dp[l][r] = l + r;
+                continue;
+            }
+            dp[l][r] = std::min(
+                std::min(dp[l][r - 1], dp[l - 1][r]) + 1,
+                dp[l - 1][r - 1] + (left[l - 1] != right[r - 1]));
+            if (l > 1 && r > 1 && left[l - 1] == right[r - 2] &&
+                left[l - 2] == right[r - 1]) {
+                dp[l][r] = std::min(dp[l][r], dp[l - 2][r - 2] + 1);
+            }
+        }
+    }
+    return dp[left.size()][right.size()];
+}
+
+// Checks that 'edits' turns 'left' into 'right' and returns its number of
+// edits other than kMatch.
+template <typename Sequence>
+size_t CheckTranspositionEdits(const Sequence &left, const Sequence &right,
+                               const std::vector<EditType> &edits) {
+    size_t l_i = 0, r_i = 0, count = 0;
+    for (size_t i = 0; i < edits.size(); ++i) {
+        count += edits[i] != kMatch;
+        if (edits[i] == kTranspose) {
+            assert(left[l_i] == right[r_i + 1]);
+            assert(left[l_i + 1] == right[r_i]);
+            l_i += 2;
+            r_i += 2;
+            continue;
+        }
+        if (edits[i] == kMatch) assert(left[l_i] == right[r_i]);
+        l_i += edits[i] != kAdd;
+        r_i += edits[i] != kRemove;
+    }
+    assert(l_i == left.size() && r_i == right.size());
+    return count;
+}
+
+// TranspositionDistance and CalculateTranspositionEdits against the
+// textbook DP, with strings past one 64-bit word.
+void test_10() {
+    assert(TranspositionDistance("ab", "ba") == 1);
+    assert(Distance("ab", "ba") == 2);
+    assert(TranspositionDistance("ca", "abc") == 3);
+    const std::vector<EditType> swap =
+        CalculateTranspositionEdits("xaby", "xbay");
+    assert(swap.size() == 3 && swap[1] == kTranspose);
+
+    for (int i = 0; i < 300; ++i) {
+        const size_t max_size = i % 3 == 0 ? 200 : 20;
+        std::string left(rand() % max_size, 'a');
+        for (size_t j = 0; j < left.size(); ++j) left[j] = 'a' + rand() % 3;
+        // Mostly swaps of the left side, for transpositions to find.
+        std::string right = left;
+        for (size_t j = 0; j + 1 < right.size(); ++j) {
+            const int r = rand() % 8;
+            if (r == 0) std::swap(right[j], right[j + 1]);
+            if (r == 1) right[j] = 'a' + rand() % 3;
+            if (r == 2) right.erase(j, 1);
+        }
+        if (rand() % 4 == 0) right.insert(0, "ab");
+        const size_t expected = ReferenceTranspositionDistance(left, right);
+        assert(TranspositionDistance(left, right) == expected);
+        assert(CheckTranspositionEdits(
+                   left, right, CalculateTranspositionEdits(left, right)) ==
+               expected);
+
+        const std::vector<size_t> left_ids(left.begin(), left.end()),
+            right_ids(right.begin(), right.end());
+        assert(TranspositionDistance(left_ids, right_ids) == expected);
+        assert(CheckTranspositionEdits(
+                   left_ids, right_ids,
+                   CalculateTranspositionEdits(left_ids, right_ids)) ==
+               expected);
+    }
+}
+
+// Intraline marks of CreateUnifiedDiff.
+void test_11() {
+    const std::vector<std::string> left = {
+        "name = server", "timeout_ms = 1500 # default", "retries = 3",
+        "mode = fast"};
+    const std::vector<std::string> right = {
+        "name = server", "timeout_ms = 2500 # default", "retries = 3",
+        "mode = safe"};
+    DiffOptions options;
+    options.context = 0;
+    options.intraline = kIntralineChars;
+    assert(CreateUnifiedDiff(left, right, options) ==
+           "@@ -2,1 +2,1 @@\n"
+           "-timeout_ms = [-1-]500 # default\n"
+           "+timeout_ms = {+2+}500 # default\n"
+           "@@ -4,1 +4,1 @@\n"
+           "-mode = [-f-]a[-st-]\n"
+           "+mode = {+s+}a{+fe+}\n");
+    options.intraline = kIntralineWords;
+    assert(CreateUnifiedDiff(left, right, options) ==
+           "@@ -2,1 +2,1 @@\n"
+           "-timeout_ms = [-1500-] # default\n"
+           "+timeout_ms = {+2500+} # default\n"
+           "@@ -4,1 +4,1 @@\n"
+           "-mode = [-fast-]\n"
+           "+mode = {+safe+}\n");
+
+    // Past kIntralineMaxEdits, the whole middle is marked; lines of runs
+    // of different sizes are left alone.
+    const std::vector<std::string> scrambled = {"<abcdefghijklmnop>"};
+    const std::vector<std::string> reversed = {"<ponmlkjihgfedcba>"};
+    options.intraline = kIntralineChars;
+    assert(CreateUnifiedDiff(scrambled, reversed, options) ==
+           "@@ -1,1 +1,1 @@\n"
+           "-<[-abcdefghijklmnop-]>\n"
+           "+<{+ponmlkjihgfedcba+}>\n");
+    const std::vector<std::string> one = {"a", "b"}, two = {"x", "y", "z"};
+    options.algorithm = kMyers;
+    assert(CreateUnifiedDiff(one, two, options) ==
+           "@@ -1,2 +1,3 @@\n-a\n-b\n+x\n+y\n+z\n");
+}
+
+// Once a Workspace fits the inputs, the calls that use it allocate nothing.
+void test_12() {
+    std::vector<std::string> left(30), right(30);
+    for (size_t i = 0; i < left.size(); ++i) {
+        left[i] = "line " + std::to_string(rand() % 20);
+        right[i] = "line " + std::to_string(rand() % 20);
+    }
+    const std::string long_left(150, 'a'), long_right(140, 'b');
+    const std::vector<EditType> expected = CalculateOptimalEdits(left, right);
+
+    Workspace workspace;
+    DiffOptions options;
+    options.workspace = &workspace;
+    std::vector<EditType> edits;
+    CalculateOptimalEdits(left, right, options, &edits);
+    Distance(long_left, long_right, &workspace);
+    Distance("ab", "ba");
+    size_t before = allocations;
+    for (int i = 0; i < 100; ++i) {
+        CalculateOptimalEdits(left, right, options, &edits);
+        assert(edits == expected);
+        assert(Distance(long_left, long_right, &workspace) == 150);
+        assert(Distance("kitten", "sitting") == 3);
+    }
+    assert(allocations == before);
+
+    // The thread's own workspace serves the calls that return a vector, so
+    // only the result is allocated.
+    before = allocations;
+    assert(CalculateOptimalEdits(left, right) == expected);
+    assert(allocations == before + 1);
+    workspace.Clear();
+    CalculateOptimalEdits(left, right, options, &edits);
+    assert(edits == expected);
+}
+
+// Returns the output of Merge3 and WriteMerge3, with the number of
+// conflicts in 'conflicts'.
+std::string Merged(const std::vector<std::string> &base,
+                   const std::vector<std::string> &ours,
+                   const std::vector<std::string> &theirs, Algorithm algorithm,
+                   size_t *conflicts) {
+    DiffOptions options;
+    options.algorithm = algorithm;
+    std::string merged;
+    *conflicts = WriteMerge3(base, ours, theirs,
+                             Merge3(base, ours, theirs, options),
+                             [&merged](std::string_view block) {
+                                 merged.append(block.data(), block.size());
+                             });
+    return merged;
+}
+
+// Three-way merge: changes of one side, of both, conflicts, and the merge of
+// random edits against the obvious cases.
+void test_13() {
+    const std::vector<std::string> base = {"a", "b", "c", "d", "e"};
+    const std::vector<std::string> ours = {"a", "B", "c", "d", "e", "f"};
+    const std::vector<std::string> theirs = {"a", "b", "c", "D", "e"};
+    size_t conflicts;
+    assert(Merged(base, ours, theirs, kMyers, &conflicts) ==
+           "a\nB\nc\nD\ne\nf\n");
+    assert(conflicts == 0);
+
+    const std::vector<MergeRegion> regions = Merge3(base, ours, theirs);
+    assert(regions.size() == 6);
+    assert(regions[1].kind == MergeRegion::kOurs);
+    assert(regions[1].base_begin == 1 && regions[1].base_end == 2);
+    assert(regions[3].kind == MergeRegion::kTheirs);
+    assert(regions[5].kind == MergeRegion::kOurs);
+    assert(regions[5].ours_begin == 5 && regions[5].ours_end == 6);
+    assert(regions[5].base_begin == 5 && regions[5].base_end == 5);
+
+    const std::vector<std::string> same = {"a", "x", "c", "d", "e"};
+    assert(Merged(base, same, same, kWagnerFischer, &conflicts) ==
+           "a\nx\nc\nd\ne\n");
+    assert(conflicts == 0);
+    assert(Merge3(base, same, same)[1].kind == MergeRegion::kBoth);
+
+    const std::vector<std::string> other = {"a", "y", "z", "c", "d", "e"};
+    assert(Merged(base, same, other, kMyers, &conflicts) ==
+           "a\n<<<<<<< ours\nx\n||||||| base\nb\n=======\ny\nz\n"
+           ">>>>>>> theirs\nc\nd\ne\n");
+    assert(conflicts == 1);
+
+    const std::vector<std::string> empty;
+    assert(Merge3(empty, empty, empty).empty());
+    assert(Merged(empty, {"x"}, {"x"}, kMyers, &conflicts) == "x\n");
+
+    for (int iter = 0; iter < 200; ++iter) {
+        std::vector<std::string> lines[2];
+        for (std::vector<std::string> &side : lines) {
+            side.resize(rand() % 12);
+            for (std::string &line : side) {
+                line = std::string(1, 'a' + rand() % 4);
+            }
+        }
+        std::string expected;
+        for (const std::string &line : lines[1]) expected += line + "\n";
+        for (Algorithm algorithm : kAllAlgorithms) {
+            assert(Merged(lines[0], lines[0], lines[1], algorithm,
+                          &conflicts) == expected);
+            assert(Merged(lines[0], lines[1], lines[0], algorithm,
+                          &conflicts) == expected);
+            assert(Merged(lines[0], lines[1], lines[1], algorithm,
+                          &conflicts) == expected);
+            assert(conflicts == 0);
+        }
+    }
+}
+
+// Returns the result of 'diff' applied to 'original', or "failed <hunk>".
+std::string Patched(const std::string &original, const std::string &diff,
+                    size_t window) {
+    Patch patch;
+    size_t error_line, failed_hunk;
+    assert(ParsePatch(diff, &patch, &error_line));
+    std::vector<std::string_view> pieces;
+    if (!ApplyPatch(original, patch, window, &pieces, &failed_hunk)) {
+        return "failed " + std::to_string(failed_hunk);
+    }
+    std::string result;
+    for (std::string_view piece : pieces) result += piece;
+    return result;
+}
+
+// The patches of CreateUnifiedDiff applied back, moved, to a file, and
+// malformed.
+void test_14() {
+    for (int iter = 0; iter < 300; ++iter) {
+        std::vector<std::string> left(rand() % 30), right;
+        std::string original, expected;
+        // Every other input has distinct lines.
+        for (size_t i = 0; i < left.size(); ++i) {
+            left[i] = std::string(1, 'a' + rand() % 5);
+            if (iter % 2) left[i] += std::to_string(i);
+            original += left[i] + "\n";
+        }
+        for (const std::string &line : left) {
+            if (rand() % 4 == 0) continue;
+            if (rand() % 4 == 0) right.push_back("new");
+            right.push_back(line);
+        }
+        for (const std::string &line : right) expected += line + "\n";
+        DiffOptions options;
+        options.context = rand() % 4;
+        options.algorithm =
+            kAllAlgorithms[iter % (sizeof(kAllAlgorithms) / sizeof(Algorithm))];
+        const std::string diff = CreateUnifiedDiff(left, right, options);
+        assert(Patched(original, diff, 0) == expected);
+        // Lines added before the hunks move them all, but a hunk only finds
+        // its place again by lines that occur once and by its context.
+        if (iter % 2 && options.context > 0) {
+            assert(Patched("x\nx\n" + original, diff, 2) ==
+                   "x\nx\n" + expected);
+        }
+    }
+
+    const std::string diff = "--- a\n+++ b\n@@ -2,3 +2,3 @@\n b\n-c\n+C\n d\n";
+    assert(Patched("a\nb\nc\nd\ne", diff, 0) == "a\nb\nC\nd\ne");
+    assert(Patched("b\nc\nd\n", diff, 0) == "failed 0");
+    assert(Patched("b\nc\nd\n", diff, 1) == "b\nC\nd\n");
+    assert(Patched("a\nb\nb\nc", "@@ +3,1 @@\n+x\n@@ +5,2 @@\n c\n+y", 0) ==
+           "a\nb\nx\nb\nc\ny\n");
+
+    Patch patch;
+    size_t error_line;
+    assert(!ParsePatch("@@ -1,2 @@\n-a\n", &patch, &error_line));
+    assert(error_line == 2);
+    assert(!ParsePatch("@@ -1,1 +1,1 @@\n-a\n+b\n?\n", &patch, &error_line));
+    assert(error_line == 4);
+    assert(!ParsePatch("@@ -1,1 @@\n-a\n@@ -1,1 @@\n-a\n", &patch,
+                       &error_line));
+    assert(error_line == 4);
+    assert(!ParsePatch("@@ +1,1\n+a\n", &patch, &error_line));
+    assert(error_line == 1);
+
+    // More pieces than one writev takes.
+    std::string many;
+    std::vector<std::string_view> pieces;
+    for (int i = 0; i < 3000; ++i) many += std::to_string(i % 10);
+    for (size_t i = 0; i < many.size(); ++i) {
+        pieces.push_back(std::string_view(many).substr(i, 1));
+    }
+    char path[] = "/tmp/edit_distance_test_XXXXXX";
+    const int fd = mkstemp(path);
+    assert(WritePieces(fd, pieces));
+    close(fd);
+    MappedFile file;
+    assert(file.Open(path));
+    assert(file.data() == many);
+    unlink(path);
+}
+
+// Returns the number of kMatch in 'edits'.
+size_t CountMatches(const std::vector<EditType> &edits) {
+    return std::count(edits.begin(), edits.end(), kMatch);
+}
+
+// kSorted on sorted lists against Myers, and its fallback.
+void test_15() {
+    for (int iter = 0; iter < 300; ++iter) {
+        std::vector<size_t> left = random_ids(rand() % 60, 20);
+        std::vector<size_t> right = random_ids(rand() % 60, 20);
+        std::sort(left.begin(), left.end());
+        std::sort(right.begin(), right.end());
+        std::vector<std::string> left_lines, right_lines;
+        for (size_t id : left) left_lines.push_back(std::to_string(id));
+        for (size_t id : right) right_lines.push_back(std::to_string(id));
+        std::sort(left_lines.begin(), left_lines.end());
+        std::sort(right_lines.begin(), right_lines.end());
+
+        DiffOptions options;
+        options.algorithm = kSorted;
+        const std::vector<EditType> edits =
+            CalculateOptimalEdits(left, right, options);
+        assert(is_valid_script(left, right, edits));
+        assert(CountMatches(edits) ==
+               CountMatches(CalculateOptimalEdits(left, right, kMyers)));
+        const std::vector<EditType> line_edits =
+            CalculateOptimalEdits(left_lines, right_lines, options);
+        assert(CountMatches(line_edits) ==
+               CountMatches(
+                   CalculateOptimalEdits(left_lines, right_lines, kMyers)));
+
+        // Out of order, Myers runs instead, unless the check is off.
+        std::reverse(left.begin(), left.end());
+        if (!std::is_sorted(left.begin(), left.end())) {
+            assert(CalculateOptimalEdits(left, right, options) ==
+                   CalculateOptimalEdits(left, right, kMyers));
+        }
+        options.check_sorted = false;
+        assert(is_valid_script(left, right,
+                               CalculateOptimalEdits(left, right, options)));
+    }
+
+    const std::vector<std::string> old_list = {"a.txt", "b.txt", "d.txt"};
+    const std::vector<std::string> new_list = {"a.txt", "c.txt", "d.txt",
+                                               "e.txt"};
+    DiffOptions options;
+    options.algorithm = kSorted;
+    options.context = 0;
+    assert(CreateUnifiedDiff(old_list, new_list, options) ==
+           "@@ -2,1 +2,1 @@\n-b.txt\n+c.txt\n@@ +4,1 @@\n+e.txt\n");
+}
+
+// Expands 'runs' back into one edit per element.
+std::vector<EditType> Expand(const std::vector<EditRun> &runs) {
+    std::vector<EditType> edits;
+    for (const EditRun &run : runs) {
+        assert(run.count > 0);
+        edits.insert(edits.end(), run.count, run.type);
+    }
+    return edits;
+}
+
+// The runs of CalculateEditRuns against CalculateOptimalEdits, for all the
+// algorithms, and CountEdits.
+void test_16() {
+    for (int iter = 0; iter < 500; ++iter) {
+        const std::vector<size_t> left = random_ids(rand() % 80, 6);
+        std::vector<size_t> right = left;
+        for (size_t i = 0; i < right.size(); ++i) {
+            if (rand() % 8 == 0) right[i] = rand() % 6;
+        }
+        right.resize(right.size() - rand() % (right.size() / 4 + 1));
+        std::vector<std::string> left_lines, right_lines;
+        for (size_t id : left) left_lines.push_back(std::to_string(id));
+        for (size_t id : right) right_lines.push_back(std::to_string(id));
+
+        DiffOptions options;
+        options.algorithm = kAllAlgorithms[iter % (sizeof(kAllAlgorithms) /
+                                                   sizeof(Algorithm))];
+        options.reduce = iter % 2 == 1;
+        std::vector<EditRun> runs;
+        CalculateEditRuns(left, right, options, &runs);
+        const std::vector<EditType> edits =
+            CalculateOptimalEdits(left, right, options);
+        assert(Expand(runs) == edits);
+        for (size_t i = 1; i < runs.size(); ++i) {
+            assert(runs[i].type != runs[i - 1].type);
+        }
+        CalculateEditRuns(left_lines, right_lines, options, &runs);
+        assert(Expand(runs) ==
+               CalculateOptimalEdits(left_lines, right_lines, options));
+
+        const EditCounts counts = CountEdits(runs);
+        const EditCounts expected = CountEdits(edits);
+        assert(counts.matches == expected.matches);
+        assert(counts.adds == expected.adds);
+        assert(counts.removes == expected.removes);
+        assert(counts.replaces == expected.replaces);
+        assert(counts.transposes == 0);
+        assert(counts.matches + counts.removes + counts.replaces ==
+               left.size());
+        assert(counts.matches + counts.adds + counts.replaces ==
+               right.size());
+    }
+
+    // Two changes in 100000 lines are six runs.
+    std::vector<std::string> left(100000);
+    for (size_t i = 0; i < left.size(); ++i) left[i] = std::to_string(i);
+    std::vector<std::string> right = left;
+    right[10] = "changed";
+    right.erase(right.begin() + 50000);
+    DiffOptions options;
+    options.algorithm = kMyers;
+    std::vector<EditRun> runs;
+    CalculateEditRuns(left, right, options, &runs);
+    assert(runs.size() == 6);
+    assert(runs[0].type == kMatch && runs[0].count == 10);
+    assert(runs[1].type == kRemove && runs[1].count == 1);
+    assert(runs[2].type == kAdd && runs[2].count == 1);
+    assert(runs[4].type == kRemove && runs[4].count == 1);
+    assert(CountEdits(runs).matches == 99998);
+
+    // The DPs that split their work, past the sizes where they do.
+    const std::vector<size_t> big_left = random_ids(1100, 20);
+    std::vector<size_t> big_right = big_left;
+    for (size_t i = 0; i < big_right.size(); i += 7) big_right[i] = rand() % 20;
+    for (Algorithm algorithm : {kLinearSpace, kParallel}) {
+        options.algorithm = algorithm;
+        CalculateEditRuns(big_left, big_right, options, &runs);
+        assert(Expand(runs) ==
+               CalculateOptimalEdits(big_left, big_right, options));
+        assert(Expand(runs) == CalculateOptimalEdits(big_left, big_right));
+    }
+}
+
+// DiffCache: hits, misses and evictions in memory, the options in the key,
+// and a store shared by two caches.
+void test_17() {
+    const std::vector<std::string> left = {"a", "b", "c", "d"};
+    const std::vector<std::string> right = {"a", "x", "c", "d", "e"};
+    const std::string expected = CreateUnifiedDiff(left, right);
+
+    // Line boundaries are part of the hash.
+    const std::vector<std::string> joined = {"ab"}, split = {"a", "b"};
+    const std::vector<std::string> none, empty_line = {""};
+    assert(HashLines(joined).low != HashLines(split).low);
+    assert(HashLines(none).low != HashLines(empty_line).low);
+    const std::vector<std::string_view> views(left.begin(), left.end());
+    assert(HashLines(views).low == HashLines(left).low &&
+           HashLines(views).high == HashLines(left).high);
+
+    DiffCache cache(1 << 20);
+    assert(cache.CreateUnifiedDiff(left, right) == expected);
+    assert(cache.CreateUnifiedDiff(left, right) == expected);
+    assert(cache.CreateUnifiedDiff(views, std::vector<std::string_view>(
+                                              right.begin(), right.end())) ==
+           expected);
+    DiffOptions options;
+    options.context = 0;
+    assert(cache.CreateUnifiedDiff(left, right, options) ==
+           CreateUnifiedDiff(left, right, options));
+    options.context = 2;
+    options.algorithm = kMyers;
+    cache.CreateUnifiedDiff(left, right, options);
+    DiffCacheStats stats = cache.stats();
+    assert(stats.memory_hits == 2 && stats.misses == 3);
+    assert(stats.entries == 3 && stats.evictions == 0);
+
+    // Room for two diffs: the least recently used one goes.
+    DiffCache small(2 * (expected.size() + 200));
+    std::vector<std::string> other = right;
+    for (int i = 0; i < 3; ++i) {
+        other.push_back("f");
+        small.CreateUnifiedDiff(left, other);
+    }
+    stats = small.stats();
+    assert(stats.misses == 3 && stats.evictions >= 1);
+    assert(stats.memory_bytes <= 2 * (expected.size() + 200));
+    small.CreateUnifiedDiff(left, other);
+    assert(small.stats().memory_hits == 1);
+    small.Clear();
+    assert(small.stats().entries == 0 && small.stats().memory_bytes == 0);
+
+    char path[] = "/tmp/edit_distance_test_XXXXXX";
+    close(mkstemp(path));
+    DiffCache writer(1 << 20), reader(1 << 20);
+    assert(writer.OpenStore(path) && reader.OpenStore(path));
+    assert(writer.CreateUnifiedDiff(left, right) == expected);
+    // Stored after the reader opened the store.
+    assert(reader.CreateUnifiedDiff(left, right) == expected);
+    assert(reader.stats().disk_hits == 1 && reader.stats().misses == 0);
+    assert(reader.CreateUnifiedDiff(left, right) == expected);
+    assert(reader.stats().memory_hits == 1);
+    DiffCache reopened(0);
+    assert(reopened.OpenStore(path));
+    for (int i = 0; i < 2; ++i) {
+        assert(reopened.CreateUnifiedDiff(left, right) == expected);
+    }
+    assert(reopened.stats().disk_hits == 2 && reopened.stats().entries == 0);
+
+    // Garbage, then a record after it.
+    FILE *file = fopen(path, "a");
+    fputs("torn record", file);
+    fclose(file);
+    DiffOptions unchanged;
+    unchanged.context = 0;
+    const std::string zero_context = CreateUnifiedDiff(left, right, unchanged);
+    assert(writer.CreateUnifiedDiff(left, right, unchanged) == zero_context);
+    assert(reader.CreateUnifiedDiff(left, right, unchanged) == zero_context);
+    assert(reader.stats().disk_hits == 2 && reader.stats().misses == 0);
+
+    // A record torn by a crash waits to be completed, and is skipped once
+    // another starts after it.
+    unchanged.context = 1;
+    assert(writer.CreateUnifiedDiff(left, right, unchanged) ==
+           CreateUnifiedDiff(left, right, unchanged));
+    struct stat st;
+    assert(stat(path, &st) == 0 && truncate(path, st.st_size - 12) == 0);
+    DiffCache after_crash(1 << 20);
+    assert(after_crash.OpenStore(path));
+    after_crash.CreateUnifiedDiff(left, right, unchanged);
+    assert(after_crash.stats().misses == 1);
+    DiffCache skipping(1 << 20);
+    assert(skipping.OpenStore(path));
+    for (int context = 0; context < 2; ++context) {
+        unchanged.context = context;
+        skipping.CreateUnifiedDiff(left, right, unchanged);
+    }
+    assert(skipping.stats().disk_hits == 2 && skipping.stats().misses == 0);
+
+    // A diff that fails its hash is a miss, and is stored again.
+    file = fopen(path, "r+");
+    std::string content(st.st_size, '\0');
+    content.resize(fread(&content[0], 1, content.size(), file));
+    const size_t at = content.find(expected);
+    assert(at != std::string::npos);
+    fseek(file, at + expected.size() - 2, SEEK_SET);
+    fputc('y', file);
+    fclose(file);
+    for (int i = 0; i < 2; ++i) {
+        DiffCache checked(1 << 20);
+        assert(checked.OpenStore(path));
+        assert(checked.CreateUnifiedDiff(left, right) == expected);
+        assert(checked.stats().disk_hits == static_cast<size_t>(i));
+    }
+
+    // A file that is not a store.
+    write_file(path, "not a store");
+    assert(!reopened.OpenStore(path));
+    unlink(path);
+}
+
+int main() {
+    test_1();
+    test_2();
+    test_3();
+    test_4();
+    test_5();
+    test_6();
+    test_7();
+    test_8();
+    test_9();
+    test_10();
+    test_11();
+    test_12();
+    test_13();
+    test_14();
+    test_15();
+    test_16();
+    test_17();
+
+    return 0;
+}